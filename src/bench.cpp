@@ -0,0 +1,218 @@
+// Headless physics benchmark. Doesn't create a window or an OpenGL context.
+//
+// Usage: cube-bench [--scene chain|box] [--bodies N] [--frames N] [--dt seconds] [--perf]
+//                   [--trajectory file [--quantize step]] [--jacobian] [--meshes]
+//
+// With --perf, reads hardware performance counters around the physics hot spots
+// (see util/perf-counters.h) and reports IPC and cache/branch misses.
+// With --trajectory, writes every substep to a trajectory file (see sim/trajectory.h).
+// With --jacobian, times Scene::StepJacobian() at the final state against central differences of
+// PhysicsStep()s, and reports the largest difference between the two.
+// With --meshes, reports what BuildIndexedMesh() makes of each of the scene's meshes for upload.
+#include <iostream>
+#include <iomanip>
+#include <cstring>
+#include "util/exceptions.h"
+#include "util/stopwatch.h"
+#include "util/perf-counters.h"
+#include "sim/mesh-build.h"
+#include "sim/scene.h"
+#include "sim/snapshot.h"
+#include "sim/trajectory.h"
+using namespace std;
+
+// The scene from main.cpp: a cube balancing on one of its corners.
+static void BuildBoxScene(Scene& scene) {
+  Body* box = scene.AddBody(MakeBox(dvec3(.06,.06,.06)).MultiplyMass(1000));
+  box->pos = dvec3(.03, .03, 0);
+  scene.AddConstraint(-1, box->idx, dvec3(-.03, -.03, -.03), dquat(1, 0, 0, 0), Constraint::DOF::POS | Constraint::DOF::RX | Constraint::DOF::RY);
+  scene.gravity = dvec3(0, -9.8, 0);
+}
+
+// A pendulum of `n` rods connected with ball joints, starting horizontal.
+static void BuildChainScene(Scene& scene, int n) {
+  const double len = .1;
+  for (int i = 0; i < n; ++i) {
+    Body* b = scene.AddBody(MakeBox(dvec3(len, .02, .02)).MultiplyMass(1000));
+    b->pos = dvec3(len * (i + .5), 0, 0);
+    scene.AddConstraint(i - 1, b->idx, dvec3(-len/2, 0, 0), dquat(1, 0, 0, 0), Constraint::DOF::POS);
+  }
+  scene.gravity = dvec3(0, -9.8, 0);
+}
+
+static void Report(const char* name, const PerfCounters& c, size_t bodies) {
+  const auto& t = c.totals();
+  cout << "  " << setw(20) << left << name << right
+       << " calls: " << setw(8) << t.calls
+       << "  us/call: " << setw(9) << t.seconds / t.calls * 1e6;
+  if (c.Available(PerfCounters::CYCLES) && c.Available(PerfCounters::INSTRUCTIONS))
+    cout << "  IPC: " << setw(5) << t.IPC();
+  const PerfCounters::Event per_body[] = {
+    PerfCounters::L1D_MISSES, PerfCounters::LLC_MISSES, PerfCounters::BRANCH_MISSES};
+  for (PerfCounters::Event e: per_body) {
+    if (c.Available(e))
+      cout << "  " << PerfCounters::EventName(e) << "/body/call: " << setw(7) << t.events[e] / t.calls / bodies;
+  }
+  cout << endl;
+}
+
+// Vertices and FIFO-16 average cache miss ratio of each mesh as the triangle soup it's built from
+// and as indexed and ordered by BuildIndexedMesh().
+static void ReportMeshes(const Scene& scene) {
+  for (size_t i = 0; i < scene.meshes.size(); ++i) {
+    const vector<BodyEdit::Vertex>& soup = scene.meshes[i].vertices;
+    vector<uint32_t> soup_indices(soup.size());
+    for (size_t j = 0; j < soup.size(); ++j)
+      soup_indices[j] = j;
+    Stopwatch stopwatch;
+    IndexedMesh indexed = BuildIndexedMesh(soup);
+    double seconds = stopwatch.TimeSinceRestart();
+    cout << "mesh " << i << ": " << soup.size() / 3 << " triangles, vertices: " << soup.size() << " -> "
+         << indexed.vertices.size() << ", ACMR: " << AverageCacheMissRatio(soup_indices) << " -> "
+         << AverageCacheMissRatio(indexed.indices) << ", built in " << seconds * 1e3 << " ms" << endl;
+  }
+}
+
+static void CompareJacobian(Scene& scene, double dt) {
+  const int n = BodyState::kComponents;
+  const size_t size = scene.bodies.size() * n;
+  Stopwatch stopwatch;
+  DMatrix jacobian;
+  scene.StepJacobian(dt, jacobian);
+  double jacobian_seconds = stopwatch.Restart();
+
+  // Column j from the states after stepping from the state with component j moved either way.
+  SceneSnapshot snapshot(scene);
+  vector<BodyState> after[2];
+  double max_difference = 0, max_entry = 0;
+  for (size_t j = 0; j < size; ++j) {
+    double moved[2];
+    for (int side = 0; side < 2; ++side) {
+      snapshot.Restore(scene);
+      Body& b = scene.bodies[j / n];
+      BodyState s;
+      s.FromBody(b);
+      double& x = s.Component(j % n);
+      x += (side ? -1e-6 : 1e-6) * max(1., abs(x));
+      moved[side] = x;
+      s.ToBody(b);
+      scene.PhysicsStep(dt);
+      after[side].resize(scene.bodies.size());
+      for (size_t i = 0; i < scene.bodies.size(); ++i)
+        after[side][i].FromBody(scene.bodies[i]);
+    }
+    for (size_t i = 0; i < size; ++i) {
+      double d = (after[0][i / n].Component(i % n) - after[1][i / n].Component(i % n)) / (moved[0] - moved[1]);
+      max_difference = max(max_difference, abs(d - jacobian[i][j]));
+      max_entry = max(max_entry, abs(jacobian[i][j]));
+    }
+  }
+  double differences_seconds = stopwatch.Restart();
+  snapshot.Restore(scene);
+
+  cout << "StepJacobian: " << size << "x" << size << " in " << jacobian_seconds * 1e3 << " ms, central differences ("
+       << 2 * size << " PhysicsSteps): " << differences_seconds * 1e3 << " ms; largest difference: "
+       << max_difference << " (largest entry: " << max_entry << ")" << endl;
+}
+
+int main(int argc, char** argv) {
+  try {
+    string scene_name = "chain";
+    int bodies = 10;
+    int frames = 600;
+    double dt = 1./60;
+    bool perf = false;
+    string trajectory_path;
+    double quantize = 0;
+    bool jacobian = false;
+    bool meshes = false;
+    for (int i = 1; i < argc; ++i) {
+      auto value = [&] {
+        if (i + 1 >= argc)
+          throw CommandLineArgumentsException(string("missing value for ") + argv[i]);
+        return argv[++i];
+      };
+      if (!strcmp(argv[i], "--scene"))
+        scene_name = value();
+      else if (!strcmp(argv[i], "--bodies"))
+        bodies = atoi(value());
+      else if (!strcmp(argv[i], "--frames"))
+        frames = atoi(value());
+      else if (!strcmp(argv[i], "--dt"))
+        dt = atof(value());
+      else if (!strcmp(argv[i], "--perf"))
+        perf = true;
+      else if (!strcmp(argv[i], "--trajectory"))
+        trajectory_path = value();
+      else if (!strcmp(argv[i], "--quantize"))
+        quantize = atof(value());
+      else if (!strcmp(argv[i], "--jacobian"))
+        jacobian = true;
+      else if (!strcmp(argv[i], "--meshes"))
+        meshes = true;
+      else
+        throw CommandLineArgumentsException(string("unknown argument ") + argv[i]);
+    }
+
+    Scene scene;
+    if (scene_name == "box")
+      BuildBoxScene(scene);
+    else if (scene_name == "chain")
+      BuildChainScene(scene, bodies);
+    else
+      throw CommandLineArgumentsException("unknown scene " + scene_name);
+    if (meshes)
+      ReportMeshes(scene);
+
+    Scene::PhysicsProfile profile;
+    if (perf) {
+      scene.profile = &profile;
+      if (!profile.runge_kutta.Available(PerfCounters::CYCLES))
+        cerr << "hardware performance counters are not available, only timing will be reported" << endl;
+    }
+
+    unique_ptr<TrajectoryWriter> trajectory;
+    if (!trajectory_path.empty()) {
+      TrajectoryOptions options;
+      options.pos_step = options.rot_step = options.momentum_step = options.ang_step = quantize;
+      trajectory.reset(new TrajectoryWriter(trajectory_path, scene.bodies.size(), options));
+      scene.trajectory_sink = trajectory.get();
+    }
+
+    PerfCounters step_counters;
+    double e0 = scene.GetEnergy();
+    for (int i = 0; i < frames; ++i) {
+      PerfRegion perf_region(&step_counters);
+      scene.PhysicsStep(dt);
+    }
+
+    cout << scene_name << ": " << scene.bodies.size() << " bodies, " << scene.constraints.size() << " constraints, "
+         << frames << " frames" << endl;
+    Report("PhysicsStep", step_counters, scene.bodies.size());
+    if (perf) {
+      Report("RungeKutta4", profile.runge_kutta, scene.bodies.size());
+      Report("ResolveForces", profile.resolve_forces, scene.bodies.size());
+      Report("SolveLinearSystem", profile.solve_linear_system, scene.bodies.size());
+    }
+    if (trajectory) {
+      Stopwatch finish_stopwatch;
+      trajectory->Finish();
+      cout << "trajectory: " << trajectory->samples() << " samples, " << trajectory->stalls() << " stalls, "
+           << finish_stopwatch.TimeSinceRestart() << " s to finish writing" << endl;
+    }
+    cout << "energy drift: " << scene.GetEnergy() - e0
+         << "; leaked:  x: " << scene.leaked_translation << ", r: " << scene.leaked_rotation
+         << ", v: " << scene.leaked_velocity << ", w: " << scene.leaked_angular_velocity
+         << "  res ok: " << scene.force_resolution_success << " fail: " << scene.force_resolution_failed << endl;
+    if (jacobian) {
+      scene.profile = nullptr;
+      scene.trajectory_sink = nullptr;
+      CompareJacobian(scene, dt);
+    }
+  } catch (std::exception& e) {
+    std::cerr << "exception: " << e.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
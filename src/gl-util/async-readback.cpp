@@ -0,0 +1,73 @@
+#include "gl-util/async-readback.h"
+#include "util/exceptions.h"
+
+namespace GL {
+
+AsyncReadback::AsyncReadback(ivec2 size, size_t buffers): size_(size), slots_(buffers) {
+  for (Slot& s: slots_) {
+    glGenBuffers(1, &s.pbo);CHECK_GL_ERROR();
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, s.pbo);CHECK_GL_ERROR();
+    glBufferData(GL_PIXEL_PACK_BUFFER, size.x * size.y * 4, nullptr, GL_STREAM_READ);CHECK_GL_ERROR();
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);CHECK_GL_ERROR();
+}
+
+AsyncReadback::~AsyncReadback() {
+  for (Slot& s: slots_) {
+    if (s.fence)
+      glDeleteSync(s.fence);
+    glDeleteBuffers(1, &s.pbo);
+  }
+  SOFT_CHECK_GL_ERROR();
+}
+
+void AsyncReadback::Capture(uint64_t tag, const Consumer& consume) {
+  Poll(consume);
+  if (pending_ == slots_.size()) {
+    ++stalls_;
+    ConsumeOldest(consume, true);
+  }
+
+  Slot& s = slots_[(oldest_ + pending_) % slots_.size()];
+  s.tag = tag;
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, s.pbo);CHECK_GL_ERROR();
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);CHECK_GL_ERROR();
+  // With a pack buffer bound the last argument is an offset into it, and the call doesn't wait.
+  glReadPixels(0, 0, size_.x, size_.y, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);CHECK_GL_ERROR();
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);CHECK_GL_ERROR();
+  s.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);CHECK_GL_ERROR();
+  ++pending_;
+}
+
+void AsyncReadback::Poll(const Consumer& consume, bool wait) {
+  while (pending_ && ConsumeOldest(consume, wait)) {}
+}
+
+bool AsyncReadback::ConsumeOldest(const Consumer& consume, bool wait) {
+  Slot& s = slots_[oldest_];
+  // Flush so that the fence is guaranteed to signal eventually.
+  GLenum res = glClientWaitSync(s.fence, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? GL_TIMEOUT_IGNORED : 0);CHECK_GL_ERROR();
+  if (res == GL_TIMEOUT_EXPIRED)
+    return false;
+  if (res == GL_WAIT_FAILED)
+    throw GLException("glClientWaitSync failed");
+  glDeleteSync(s.fence);
+  s.fence = nullptr;
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, s.pbo);CHECK_GL_ERROR();
+  const uint8_t* pixels = (const uint8_t*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size_.x * size_.y * 4, GL_MAP_READ_BIT);CHECK_GL_ERROR();
+  oldest_ = (oldest_ + 1) % slots_.size();
+  --pending_;
+  try {
+    consume(s.tag, pixels);
+  } catch (...) {
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    throw;
+  }
+  glUnmapBuffer(GL_PIXEL_PACK_BUFFER);CHECK_GL_ERROR();
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);CHECK_GL_ERROR();
+  return true;
+}
+
+}
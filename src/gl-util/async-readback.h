@@ -0,0 +1,56 @@
+#pragma once
+#include "gl-util/gl-common.h"
+#include "util/vec.h"
+#include <functional>
+#include <vector>
+
+namespace GL {
+
+// Reads frames back from the GPU without stalling the pipeline: glReadPixels() goes into
+// one of a ring of pixel buffer objects and returns immediately; the pixels are mapped only
+// after a fence says the copy is done, typically a couple of frames later.
+//
+//   readback.Capture(frame_idx, consume); // after rendering each frame
+//   ...
+//   readback.Poll(consume, true); // at the end, to get the remaining frames
+//
+// `consume` gets RGBA pixels, rows bottom to top, valid only during the call.
+class AsyncReadback {
+ public:
+  using Consumer = std::function<void(uint64_t tag, const uint8_t* pixels)>;
+
+  AsyncReadback(ivec2 size, size_t buffers = 3);
+  ~AsyncReadback();
+
+  AsyncReadback(const AsyncReadback& rhs) = delete;
+  AsyncReadback& operator=(const AsyncReadback& rhs) = delete;
+
+  // Starts reading the current read framebuffer. Finished reads are passed to `consume` first;
+  // if all buffers are still busy, waits for the oldest one.
+  void Capture(uint64_t tag, const Consumer& consume);
+  // Passes finished reads to `consume`, oldest first. With `wait`, waits for all pending reads.
+  void Poll(const Consumer& consume, bool wait = false);
+
+  // Number of times Capture() had to wait for the GPU.
+  size_t stalls() const {
+    return stalls_;
+  }
+
+ private:
+  struct Slot {
+    GLuint pbo = 0;
+    GLsync fence = nullptr;
+    uint64_t tag = 0;
+  };
+
+  ivec2 size_;
+  std::vector<Slot> slots_;
+  size_t oldest_ = 0;  // oldest pending read
+  size_t pending_ = 0;
+  size_t stalls_ = 0;
+
+  // Returns false if the oldest read is not finished and `wait` is false.
+  bool ConsumeOldest(const Consumer& consume, bool wait);
+};
+
+}
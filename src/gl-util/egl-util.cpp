@@ -0,0 +1,92 @@
+#include "egl-util.h"
+#include "util/exceptions.h"
+#define EGL_NO_X11
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+namespace egl {
+
+static EGLDisplay GetDisplay() {
+  // Prefer the surfaceless platform: it works without X11/Wayland and without a GPU.
+  auto get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+  if (get_platform_display) {
+    EGLDisplay d = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    if (d != EGL_NO_DISPLAY)
+      return d;
+  }
+  return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+HeadlessWindow::HeadlessWindow(ivec2 size, bool debug): size_(size) {
+  EGLDisplay display = GetDisplay();
+  EGLint major, minor;
+  if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+    throw GLException("couldn't initialize EGL");
+  display_ = display;
+
+  EGLint config_attrs[] = {
+    EGL_SURFACE_TYPE, 0, // any; the default is window-capable only
+    EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+    EGL_NONE
+  };
+  EGLConfig config;
+  EGLint configs = 0;
+  if (!eglChooseConfig(display, config_attrs, &config, 1, &configs) || !configs) {
+    eglTerminate(display);
+    throw GLException("no EGL config with desktop OpenGL");
+  }
+  eglBindAPI(EGL_OPENGL_API);
+  EGLint context_attrs[] = {
+    EGL_CONTEXT_MAJOR_VERSION, 3,
+    EGL_CONTEXT_MINOR_VERSION, 3,
+    EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+    EGL_CONTEXT_OPENGL_DEBUG, debug ? EGL_TRUE : EGL_FALSE,
+    EGL_NONE
+  };
+  EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attrs);
+  if (context == EGL_NO_CONTEXT) {
+    eglTerminate(display);
+    throw GLException("couldn't create EGL context");
+  }
+  context_ = context;
+  // No surface at all (EGL_KHR_surfaceless_context); we draw into our own framebuffer.
+  if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+    eglDestroyContext(display, context);
+    eglTerminate(display);
+    throw GLException("couldn't make surfaceless EGL context current");
+  }
+  GL::InitGl3wIfNeeded();
+
+  glGenRenderbuffers(1, &color_);CHECK_GL_ERROR();
+  glBindRenderbuffer(GL_RENDERBUFFER, color_);CHECK_GL_ERROR();
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, size.x, size.y);CHECK_GL_ERROR();
+  glGenRenderbuffers(1, &depth_);CHECK_GL_ERROR();
+  glBindRenderbuffer(GL_RENDERBUFFER, depth_);CHECK_GL_ERROR();
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, size.x, size.y);CHECK_GL_ERROR();
+  glGenFramebuffers(1, &fbo_);CHECK_GL_ERROR();
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo_);CHECK_GL_ERROR();
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color_);CHECK_GL_ERROR();
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth_);CHECK_GL_ERROR();
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    throw GLException("offscreen framebuffer is incomplete");
+  MakeCurrent();
+}
+
+HeadlessWindow::~HeadlessWindow() {
+  EGLDisplay display = display_;
+  eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context_);
+  glDeleteFramebuffers(1, &fbo_);
+  glDeleteRenderbuffers(1, &color_);
+  glDeleteRenderbuffers(1, &depth_);
+  eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  eglDestroyContext(display, context_);
+  eglTerminate(display);
+}
+
+void HeadlessWindow::MakeCurrent() {
+  eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, context_);
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo_);CHECK_GL_ERROR();
+  glViewport(0, 0, size_.x, size_.y);CHECK_GL_ERROR();
+}
+
+}
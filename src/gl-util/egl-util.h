@@ -0,0 +1,43 @@
+#pragma once
+
+#include "gl-common.h"
+#include "util/vec.h"
+
+namespace egl {
+
+// Headless counterpart of glfw::Window: an OpenGL 3.3 core context that needs no display
+// server (EGL "surfaceless" platform, e.g. Mesa's llvmpipe software rasterizer), drawing
+// into an offscreen framebuffer object of fixed size. Read the results with glReadPixels().
+// Only available where EGL is (HAVE_EGL).
+class HeadlessWindow {
+ public:
+  // Throws GLException if there's no usable EGL device or context.
+  // `debug` requests a debug context, for GL::EnableDebugOutput().
+  explicit HeadlessWindow(ivec2 size, bool debug = false);
+  ~HeadlessWindow();
+
+  HeadlessWindow(const HeadlessWindow& rhs) = delete;
+  HeadlessWindow& operator=(const HeadlessWindow& rhs) = delete;
+
+  // Also binds the framebuffer and sets the viewport to cover it.
+  void MakeCurrent();
+
+  ivec2 GetFramebufferSize() const {
+    return size_;
+  }
+
+  // Nothing to present; only submits the queued commands.
+  void SwapBuffers() {
+    glFlush();
+  }
+
+ private:
+  ivec2 size_;
+  void* display_ = nullptr; // EGLDisplay
+  void* context_ = nullptr; // EGLContext
+  GLuint fbo_ = 0;
+  GLuint color_ = 0;
+  GLuint depth_ = 0;
+};
+
+}
@@ -1,7 +1,9 @@
 #include "gl-common.h"
+#include <cstring>
 #include <iostream>
 #include <map>
 #include <mutex>
+#include "util/debug.h"
 #include "util/exceptions.h"
 
 namespace GL {
@@ -57,6 +59,49 @@ void LogInfo() {
   std::cerr << std::endl;
 }
 
+bool HasExtension(const char *name) {
+  GLint count = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &count); CHECK_GL_ERROR();
+  for (GLint i = 0; i < count; ++i) {
+    if (!strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), name))
+      return true;
+  }
+  return false;
+}
+
+static const char* DebugTypeName(GLenum type) {
+  switch (type) {
+    case GL_DEBUG_TYPE_ERROR: return "error";
+    case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "deprecated";
+    case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR: return "undefined behavior";
+    case GL_DEBUG_TYPE_PORTABILITY: return "portability";
+    case GL_DEBUG_TYPE_PERFORMANCE: return "performance";
+    default: return "other";
+  }
+}
+
+static void APIENTRY DebugMessage(GLenum source, GLenum type, GLuint id, GLenum severity,
+                                  GLsizei length, const GLchar *message, GLvoid *user) {
+  std::cerr << "GL " << DebugTypeName(type) << " (" << id << "): " << message << std::endl;
+  if (type == GL_DEBUG_TYPE_ERROR)
+    MaybeDebugBreak();
+}
+
+bool EnableDebugOutput(bool synchronous) {
+  if (!gl3wIsSupported(4, 3) && !HasExtension("GL_KHR_debug"))
+    return false;
+  glDebugMessageCallback(&DebugMessage, nullptr);
+  // Notifications (e.g. "buffer will use video memory") are just noise.
+  glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr, GL_FALSE);
+  glEnable(GL_DEBUG_OUTPUT);
+  if (synchronous)
+    glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+  else
+    glDisable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+  CHECK_GL_ERROR();
+  return true;
+}
+
 void InitGl3wIfNeeded() {
   static std::once_flag flag;
   std::call_once(flag, [](){
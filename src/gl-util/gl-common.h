@@ -9,12 +9,30 @@ void ThrowIfError(const char *file, int line);
 // Returns true if glError() returns non-success.
 bool LogIfError(const char *file, int line);
 
+// glGetError() after GL calls makes the driver synchronize, so release builds
+// (GL_NO_ERROR_CHECKS, see CMakeLists.txt) compile the checks out and rely on
+// EnableDebugOutput() to report errors.
+#ifdef GL_NO_ERROR_CHECKS
+#define CHECK_GL_ERROR() ((void)0)
+#define SOFT_CHECK_GL_ERROR() ((void)0)
+#else
 #define CHECK_GL_ERROR() GL::ThrowIfError(__FILE__, __LINE__)
 #define SOFT_CHECK_GL_ERROR() GL::LogIfError(__FILE__, __LINE__)
+#endif
+
+// Logs GL errors, warnings etc. to stderr from a KHR_debug message callback, if the context
+// supports it (GL 4.3 or KHR_debug); returns false otherwise. Errors also call MaybeDebugBreak().
+// `synchronous` makes the callback run inside the offending GL call, so that its stack trace
+// shows the culprit, at some cost in speed; otherwise messages may arrive late and from another thread.
+// Drivers report the most with a debug context, see glfw::Window and egl::HeadlessWindow.
+bool EnableDebugOutput(bool synchronous);
 
 // Log OpenGL vendor, version, extensions etc.
 void LogInfo();
 
+// Whether the current context supports the extension, e.g. "GL_ARB_buffer_storage".
+bool HasExtension(const char *name);
+
 // The first time it's called, calls gl3wInit().
 // Call after creating the first OpenGL context.
 // As a hack we rely on function addresses to be the same for all OpenGL
@@ -21,12 +21,14 @@ class Initializer {
 class Window {
  public:
   // If fullscreen, selects monitor with closest desktop rectangle.
-  Window(ivec2 position, ivec2 size, const std::string &title, bool fullscreen){
+  // `debug` requests a debug context, for GL::EnableDebugOutput().
+  Window(ivec2 position, ivec2 size, const std::string &title, bool fullscreen, bool debug = false){
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
+    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, debug ? GL_TRUE : GL_FALSE);
 
     GLFWmonitor *monitor = nullptr;
     if (fullscreen) {
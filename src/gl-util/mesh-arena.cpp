@@ -0,0 +1,121 @@
+#include "gl-util/mesh-arena.h"
+#include <algorithm>
+#include <vector>
+
+namespace GL {
+
+MeshArena::MeshArena(const VertexArray::Format& vertex_format): vertex_format_(vertex_format) {
+  multi_draw_ = gl3wIsSupported(4, 3) ||
+    (HasExtension("GL_ARB_multi_draw_indirect") && HasExtension("GL_ARB_base_instance"));
+  glGenVertexArrays(1, &vao_);CHECK_GL_ERROR();
+}
+
+MeshArena::~MeshArena() {
+  glDeleteVertexArrays(1, &vao_);
+  glDeleteBuffers(1, &vbo_);
+  for (IndexBuffer& b: indices_)
+    glDeleteBuffers(1, &b.ibo);
+  SOFT_CHECK_GL_ERROR();
+}
+
+void MeshArena::Grow(GLenum target, GLuint& buffer, size_t used, size_t capacity) {
+  GLuint grown;
+  glGenBuffers(1, &grown);CHECK_GL_ERROR();
+  glBindBuffer(GL_COPY_WRITE_BUFFER, grown);CHECK_GL_ERROR();
+  glBufferData(GL_COPY_WRITE_BUFFER, capacity, nullptr, GL_STATIC_DRAW);CHECK_GL_ERROR();
+  if (used) {
+    glBindBuffer(GL_COPY_READ_BUFFER, buffer);CHECK_GL_ERROR();
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, used);CHECK_GL_ERROR();
+  }
+  glDeleteBuffers(1, &buffer);CHECK_GL_ERROR();
+  buffer = grown;
+  glBindBuffer(target, buffer);CHECK_GL_ERROR();
+}
+
+MeshArena::Range MeshArena::Add(size_t vertices, const void* vertex_data, size_t indices, const uint32_t* index_data) {
+  size_t stride = vertex_format_.stride;
+  glBindVertexArray(vao_);CHECK_GL_ERROR();
+  if (vertices_ + vertices > vertex_capacity_) {
+    vertex_capacity_ = std::max(vertex_capacity_ * 2, vertices_ + vertices);
+    Grow(GL_ARRAY_BUFFER, vbo_, vertices_ * stride, vertex_capacity_ * stride);
+    PointAttributes(vertex_format_, vbo_, 0);
+  }
+  Range r;
+  r.index_type = vertices <= 0x10000 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+  const void* data = index_data;
+  size_t index_size = sizeof(uint32_t);
+  std::vector<uint16_t> narrow;
+  if (r.index_type == GL_UNSIGNED_SHORT) {
+    narrow.assign(index_data, index_data + indices);
+    data = narrow.data();
+    index_size = sizeof(uint16_t);
+  }
+  IndexBuffer& b = indices_[IndexBufferOf(r.index_type)];
+  // Element array binding is part of the vertex array state; MultiDraw() binds the one it needs.
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, b.ibo);CHECK_GL_ERROR();
+  if (b.count + indices > b.capacity) {
+    b.capacity = std::max(b.capacity * 2, b.count + indices);
+    Grow(GL_ELEMENT_ARRAY_BUFFER, b.ibo, b.count * index_size, b.capacity * index_size);
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, vbo_);CHECK_GL_ERROR();
+  glBufferSubData(GL_ARRAY_BUFFER, vertices_ * stride, vertices * stride, vertex_data);CHECK_GL_ERROR();
+  glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, b.count * index_size, indices * index_size, data);CHECK_GL_ERROR();
+  glBindVertexArray(0);CHECK_GL_ERROR();
+
+  r.first_index = b.count;
+  r.index_count = indices;
+  r.base_vertex = vertices_;
+  vertices_ += vertices;
+  b.count += indices;
+  return r;
+}
+
+void MeshArena::PointAttributes(const VertexArray::Format& format, GLuint buffer, size_t offset) {
+  glBindBuffer(GL_ARRAY_BUFFER, buffer);CHECK_GL_ERROR();
+  for (const VertexArray::Attribute& a: format.attributes) {
+    glEnableVertexAttribArray(a.index);CHECK_GL_ERROR();
+    glVertexAttribPointer(a.index, a.components, a.type, a.normalized, a.stride, (void*)(offset + a.offset));CHECK_GL_ERROR();
+    glVertexAttribDivisor(a.index, a.divisor);CHECK_GL_ERROR();
+  }
+}
+
+void MeshArena::SetInstanceAttributes(const VertexArray::Format& format, GLuint buffer, size_t offset) {
+  instance_format_ = &format;
+  instance_buffer_ = buffer;
+  instance_offset_ = offset;
+  if (multi_draw_) {
+    glBindVertexArray(vao_);CHECK_GL_ERROR();
+    PointAttributes(format, buffer, offset);
+    glBindVertexArray(0);CHECK_GL_ERROR();
+  }
+}
+
+size_t MeshArena::MultiDraw(GLenum index_type, const DrawCommand* commands, size_t count, GLuint buffer, size_t offset) {
+  if (!count)
+    return 0;
+  size_t index_size = index_type == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+  glBindVertexArray(vao_);CHECK_GL_ERROR();
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_[IndexBufferOf(index_type)].ibo);CHECK_GL_ERROR();
+  size_t calls = 0;
+  if (multi_draw_) {
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, buffer);CHECK_GL_ERROR();
+    glMultiDrawElementsIndirect(GL_TRIANGLES, index_type, (void*)offset, count, 0);CHECK_GL_ERROR();
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);CHECK_GL_ERROR();
+    calls = 1;
+  } else {
+    // No base instance: move the instanced attributes to each command's first instance instead.
+    for (size_t i = 0; i < count; ++i) {
+      const DrawCommand& c = commands[i];
+      if (!c.instance_count)
+        continue;
+      PointAttributes(*instance_format_, instance_buffer_, instance_offset_ + c.base_instance * instance_format_->stride);
+      glDrawElementsInstancedBaseVertex(GL_TRIANGLES, c.index_count, index_type,
+        (void*)(c.first_index * index_size), c.instance_count, c.base_vertex);CHECK_GL_ERROR();
+      ++calls;
+    }
+  }
+  glBindVertexArray(0);CHECK_GL_ERROR();
+  return calls;
+}
+
+}
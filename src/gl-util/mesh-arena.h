@@ -0,0 +1,89 @@
+#pragma once
+#include "gl-util/vertex-array.h"
+#include <vector>
+
+namespace GL {
+
+// Vertices and indices of many meshes packed into one vertex buffer and two index buffers
+// under a single vertex array object, so that a whole scene can be drawn without
+// rebinding anything but the index buffer: with one glMultiDrawElementsIndirect() call per
+// index type where supported (GL 4.3 or ARB_multi_draw_indirect + ARB_base_instance),
+// otherwise with one glDrawElementsInstancedBaseVertex() call per command.
+//
+// Indices are relative to each mesh's first vertex, so those of any mesh of up to 65536
+// vertices are stored in 16 bits, and only bigger meshes take 32.
+//
+//   MeshArena arena(vertex_format);
+//   MeshArena::Range r = arena.Add(n, vertices, count, indices);
+//   ...every frame:
+//   arena.SetInstanceAttributes(instance_format, buffer, instances_offset);
+//   commands[0] = {r.index_count, instances, r.first_index, r.base_vertex, first_instance};
+//   arena.MultiDraw(r.index_type, commands, n, buffer, commands_offset);
+class MeshArena {
+ public:
+  // Where a mesh is in the arena.
+  struct Range {
+    GLuint first_index = 0;
+    GLuint index_count = 0;
+    GLint base_vertex = 0;
+    GLenum index_type = GL_UNSIGNED_SHORT; // or GL_UNSIGNED_INT; first_index counts these
+  };
+  // Layout of glMultiDrawElementsIndirect() commands.
+  struct DrawCommand {
+    GLuint index_count;
+    GLuint instance_count;
+    GLuint first_index;
+    GLint base_vertex;
+    GLuint base_instance; // index of the first instance in the instanced attributes
+  };
+
+  // `vertex_format` describes the per-vertex attributes of all meshes.
+  explicit MeshArena(const VertexArray::Format& vertex_format);
+  ~MeshArena();
+
+  MeshArena(const MeshArena& rhs) = delete;
+  MeshArena& operator=(const MeshArena& rhs) = delete;
+
+  // Appends a mesh of `vertices` vertices; `indices` (3 per triangle) are relative to its first vertex.
+  // Buffers grow as needed.
+  Range Add(size_t vertices, const void* vertex_data, size_t indices, const uint32_t* index_data);
+
+  // Sources per-instance attributes (nonzero divisor) from `buffer` starting at byte `offset`.
+  // `format` must stay alive until the next call.
+  void SetInstanceAttributes(const VertexArray::Format& format, GLuint buffer, size_t offset);
+
+  // Draws triangles for `count` commands, all of meshes with Range::index_type `index_type`.
+  // The same commands must also be in `buffer` at byte `offset`, from where the GPU reads
+  // them if multi-draw is supported. Returns the number of draw calls issued.
+  size_t MultiDraw(GLenum index_type, const DrawCommand* commands, size_t count, GLuint buffer, size_t offset);
+
+  bool multi_draw() const {
+    return multi_draw_;
+  }
+
+ private:
+  VertexArray::Format vertex_format_;
+  GLuint vao_;
+  GLuint vbo_ = 0;
+  size_t vertices_ = 0, vertex_capacity_ = 0; // in vertices
+  struct IndexBuffer {
+    GLuint ibo = 0;
+    size_t count = 0, capacity = 0; // in indices
+  };
+  IndexBuffer indices_[2]; // 16 and 32-bit
+
+  static int IndexBufferOf(GLenum index_type) {
+    return index_type == GL_UNSIGNED_INT;
+  }
+  bool multi_draw_;
+  // Last SetInstanceAttributes(), for drawing without base instance support.
+  const VertexArray::Format* instance_format_ = nullptr;
+  GLuint instance_buffer_ = 0;
+  size_t instance_offset_ = 0;
+
+  void PointAttributes(const VertexArray::Format& format, GLuint buffer, size_t offset);
+  // Replaces `buffer` with a bigger one, keeping the first `used` bytes.
+  static void Grow(GLenum target, GLuint& buffer, size_t used, size_t capacity);
+};
+
+}
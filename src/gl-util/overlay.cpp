@@ -0,0 +1,158 @@
+#include "gl-util/overlay.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+namespace GL {
+
+// Classic 5x7 font for ' '..'~': 5 columns per character, bit 0 at the top.
+static const uint8_t kFont[95][5] = {
+  {0x00,0x00,0x00,0x00,0x00}, {0x00,0x00,0x5F,0x00,0x00}, {0x00,0x07,0x00,0x07,0x00}, {0x14,0x7F,0x14,0x7F,0x14},
+  {0x24,0x2A,0x7F,0x2A,0x12}, {0x23,0x13,0x08,0x64,0x62}, {0x36,0x49,0x55,0x22,0x50}, {0x00,0x05,0x03,0x00,0x00},
+  {0x00,0x1C,0x22,0x41,0x00}, {0x00,0x41,0x22,0x1C,0x00}, {0x14,0x08,0x3E,0x08,0x14}, {0x08,0x08,0x3E,0x08,0x08},
+  {0x00,0x50,0x30,0x00,0x00}, {0x08,0x08,0x08,0x08,0x08}, {0x00,0x60,0x60,0x00,0x00}, {0x20,0x10,0x08,0x04,0x02},
+  {0x3E,0x51,0x49,0x45,0x3E}, {0x00,0x42,0x7F,0x40,0x00}, {0x42,0x61,0x51,0x49,0x46}, {0x21,0x41,0x45,0x4B,0x31},
+  {0x18,0x14,0x12,0x7F,0x10}, {0x27,0x45,0x45,0x45,0x39}, {0x3C,0x4A,0x49,0x49,0x30}, {0x01,0x71,0x09,0x05,0x03},
+  {0x36,0x49,0x49,0x49,0x36}, {0x06,0x49,0x49,0x29,0x1E}, {0x00,0x36,0x36,0x00,0x00}, {0x00,0x56,0x36,0x00,0x00},
+  {0x08,0x14,0x22,0x41,0x00}, {0x14,0x14,0x14,0x14,0x14}, {0x00,0x41,0x22,0x14,0x08}, {0x02,0x01,0x51,0x09,0x06},
+  {0x32,0x49,0x79,0x41,0x3E}, {0x7E,0x11,0x11,0x11,0x7E}, {0x7F,0x49,0x49,0x49,0x36}, {0x3E,0x41,0x41,0x41,0x22},
+  {0x7F,0x41,0x41,0x22,0x1C}, {0x7F,0x49,0x49,0x49,0x41}, {0x7F,0x09,0x09,0x09,0x01}, {0x3E,0x41,0x49,0x49,0x7A},
+  {0x7F,0x08,0x08,0x08,0x7F}, {0x00,0x41,0x7F,0x41,0x00}, {0x20,0x40,0x41,0x3F,0x01}, {0x7F,0x08,0x14,0x22,0x41},
+  {0x7F,0x40,0x40,0x40,0x40}, {0x7F,0x02,0x0C,0x02,0x7F}, {0x7F,0x04,0x08,0x10,0x7F}, {0x3E,0x41,0x41,0x41,0x3E},
+  {0x7F,0x09,0x09,0x09,0x06}, {0x3E,0x41,0x51,0x21,0x5E}, {0x7F,0x09,0x19,0x29,0x46}, {0x46,0x49,0x49,0x49,0x31},
+  {0x01,0x01,0x7F,0x01,0x01}, {0x3F,0x40,0x40,0x40,0x3F}, {0x1F,0x20,0x40,0x20,0x1F}, {0x3F,0x40,0x38,0x40,0x3F},
+  {0x63,0x14,0x08,0x14,0x63}, {0x07,0x08,0x70,0x08,0x07}, {0x61,0x51,0x49,0x45,0x43}, {0x00,0x7F,0x41,0x41,0x00},
+  {0x02,0x04,0x08,0x10,0x20}, {0x00,0x41,0x41,0x7F,0x00}, {0x04,0x02,0x01,0x02,0x04}, {0x40,0x40,0x40,0x40,0x40},
+  {0x00,0x01,0x02,0x04,0x00}, {0x20,0x54,0x54,0x54,0x78}, {0x7F,0x48,0x44,0x44,0x38}, {0x38,0x44,0x44,0x44,0x20},
+  {0x38,0x44,0x44,0x48,0x7F}, {0x38,0x54,0x54,0x54,0x18}, {0x08,0x7E,0x09,0x01,0x02}, {0x0C,0x52,0x52,0x52,0x3E},
+  {0x7F,0x08,0x04,0x04,0x78}, {0x00,0x44,0x7D,0x40,0x00}, {0x20,0x40,0x44,0x3D,0x00}, {0x7F,0x10,0x28,0x44,0x00},
+  {0x00,0x41,0x7F,0x40,0x00}, {0x7C,0x04,0x18,0x04,0x78}, {0x7C,0x08,0x04,0x04,0x78}, {0x38,0x44,0x44,0x44,0x38},
+  {0x7C,0x14,0x14,0x14,0x08}, {0x08,0x14,0x14,0x18,0x7C}, {0x7C,0x08,0x04,0x04,0x08}, {0x48,0x54,0x54,0x54,0x20},
+  {0x04,0x3F,0x44,0x40,0x20}, {0x3C,0x40,0x40,0x20,0x7C}, {0x1C,0x20,0x40,0x20,0x1C}, {0x3C,0x40,0x30,0x40,0x3C},
+  {0x44,0x28,0x10,0x28,0x44}, {0x0C,0x50,0x50,0x50,0x3C}, {0x44,0x64,0x54,0x4C,0x44}, {0x00,0x08,0x36,0x41,0x00},
+  {0x00,0x00,0x7F,0x00,0x00}, {0x00,0x41,0x36,0x08,0x00}, {0x10,0x08,0x08,0x10,0x08},
+};
+
+// Atlas of 16x6 character cells; the cell after '~' is solid, for rectangles.
+static const int kAtlasColumns = 16;
+static const int kAtlasRows = 6;
+static const int kSolidCell = 95;
+
+static const char* vertex_shader = R"(
+  #version 330 core
+  layout(location = 0) in vec2 vert_pos; // pixels from top left
+  layout(location = 1) in vec2 vert_uv;
+  layout(location = 2) in vec4 vert_color;
+  uniform vec2 viewport_size;
+  out vec2 uv;
+  out vec4 color;
+  void main(){
+    uv = vert_uv;
+    color = vert_color;
+    gl_Position = vec4(vert_pos / viewport_size * vec2(2, -2) + vec2(-1, 1), 0, 1);
+  }
+)";
+
+static const char* fragment_shader = R"(
+  #version 330 core
+  uniform sampler2D font;
+  in vec2 uv;
+  in vec4 color;
+  out vec4 frag_color;
+  void main(){
+    frag_color = vec4(color.rgb, color.a * texture(font, uv).r);
+  }
+)";
+
+static std::vector<uint8_t> FontPixels() {
+  int w = kAtlasColumns * Overlay::kCharWidth;
+  std::vector<uint8_t> pixels(w * kAtlasRows * Overlay::kCharHeight);
+  for (int c = 0; c <= kSolidCell; ++c) {
+    int x0 = c % kAtlasColumns * Overlay::kCharWidth;
+    int y0 = c / kAtlasColumns * Overlay::kCharHeight;
+    for (int y = 0; y < Overlay::kCharHeight; ++y) {
+      for (int x = 0; x < Overlay::kCharWidth; ++x) {
+        bool on = c == kSolidCell || (x < 5 && y < 7 && (kFont[c][x] >> y & 1));
+        pixels[(y0 + y) * w + x0 + x] = on ? 255 : 0;
+      }
+    }
+  }
+  return pixels;
+}
+
+Overlay::Overlay()
+  : shader_("overlay vert", "overlay frag", vertex_shader, fragment_shader),
+    font_(ivec2(kAtlasColumns * kCharWidth, kAtlasRows * kCharHeight), GL_R8, GL_RED, GL_UNSIGNED_BYTE, FontPixels().data()),
+    vao_(0),
+    // Orphaning rather than persistent mapping: the overlay is drawn after the scene, where
+    // the fence of a persistent StreamBuffer would split the frame (0.5 ms with llvmpipe).
+    stream_(64 * 1024, 3, false) {
+  viewport_uniform_ = shader_.GetUniform("viewport_size");
+  font_uniform_ = shader_.GetUniform("font");
+}
+
+void Overlay::Begin(ivec2 viewport_size) {
+  viewport_size_ = viewport_size;
+  vertices_.clear();
+}
+
+void Overlay::Quad(float x, float y, float w, float h, float u, float v, float uw, float vh, fvec4 color) {
+  Vertex q[4];
+  for (int i = 0; i < 4; ++i) {
+    float dx = i & 1, dy = i >> 1;
+    q[i].pos[0] = x + w * dx;
+    q[i].pos[1] = y + h * dy;
+    q[i].uv[0] = u + uw * dx;
+    q[i].uv[1] = v + vh * dy;
+    q[i].color[0] = std::min(std::max(color.x, 0.f), 1.f) * 255 + .5f;
+    q[i].color[1] = std::min(std::max(color.y, 0.f), 1.f) * 255 + .5f;
+    q[i].color[2] = std::min(std::max(color.z, 0.f), 1.f) * 255 + .5f;
+    q[i].color[3] = std::min(std::max(color.w, 0.f), 1.f) * 255 + .5f;
+  }
+  for (int i: {0, 1, 2, 2, 1, 3})
+    vertices_.push_back(q[i]);
+}
+
+void Overlay::Rect(float x, float y, float w, float h, fvec4 color) {
+  // Middle of the solid cell, so that no filtering can reach its edges.
+  float u = (kSolidCell % kAtlasColumns + .5f) / kAtlasColumns;
+  float v = (kSolidCell / kAtlasColumns + .5f) / kAtlasRows;
+  Quad(x, y, w, h, u, v, 0, 0, color);
+}
+
+float Overlay::Text(float x, float y, const char* text, fvec4 color, float scale) {
+  float x0 = x;
+  float cw = kCharWidth * scale, ch = kCharHeight * scale;
+  for (const char* p = text; *p; ++p, x += cw) {
+    int c = *p - ' ';
+    if (c <= 0 || c >= kSolidCell)
+      continue;
+    Quad(x, y, cw, ch, (float)(c % kAtlasColumns) / kAtlasColumns, (float)(c / kAtlasColumns) / kAtlasRows,
+         1.f / kAtlasColumns, 1.f / kAtlasRows, color);
+  }
+  return x - x0;
+}
+
+void Overlay::End() {
+  if (vertices_.empty())
+    return;
+  size_t bytes = vertices_.size() * sizeof(Vertex);
+  memcpy(stream_.Begin(bytes), vertices_.data(), bytes);
+  size_t offset = stream_.End();
+  VertexArray::Format format(sizeof(Vertex));
+  format.Add(0, 2, GL_FLOAT, offsetof(Vertex, pos))
+        .Add(1, 2, GL_FLOAT, offsetof(Vertex, uv))
+        .Add(2, 4, GL_UNSIGNED_BYTE, offsetof(Vertex, color), true);
+  vao_.SetAttributes(format, stream_.buffer(), offset);
+
+  glDisable(GL_DEPTH_TEST);CHECK_GL_ERROR();
+  glEnable(GL_BLEND);CHECK_GL_ERROR();
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);CHECK_GL_ERROR();
+  shader_.Use();
+  shader_.SetVec2(viewport_uniform_, dvec2(viewport_size_.x, viewport_size_.y));
+  shader_.SetTexture(font_uniform_, font_, 0);
+  vao_.Draw(0, vertices_.size());
+  glDisable(GL_BLEND);CHECK_GL_ERROR();
+}
+
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include "gl-util/shader.h"
+#include "gl-util/stream-buffer.h"
+#include "gl-util/texture2d.h"
+#include "gl-util/vertex-array.h"
+#include "util/vec.h"
+#include <memory>
+#include <vector>
+
+namespace GL {
+
+// Batched 2D drawing on top of the frame, for HUDs: solid rectangles and text in a built-in
+// 5x7 pixel font, in pixels from the top left corner of the viewport.
+// Everything added between Begin() and End() is drawn by End() with a single draw call.
+class Overlay {
+ public:
+  // Size of a character cell in Text() at scale 1, in pixels.
+  static const int kCharWidth = 6;
+  static const int kCharHeight = 8;
+
+  Overlay();
+
+  Overlay(const Overlay& rhs) = delete;
+  Overlay& operator=(const Overlay& rhs) = delete;
+
+  void Begin(ivec2 viewport_size);
+  void Rect(float x, float y, float w, float h, fvec4 color);
+  // Only printable ASCII; other characters are drawn as blanks. No line breaks.
+  // Returns the width of the text in pixels.
+  float Text(float x, float y, const char* text, fvec4 color, float scale = 1);
+  // Draws with blending and without depth test; leaves both disabled.
+  void End();
+
+  // Vertices in the last batch, 6 per rectangle or character.
+  size_t vertices() const {
+    return vertices_.size();
+  }
+
+ private:
+  struct Vertex {
+    float pos[2];
+    float uv[2];
+    uint8_t color[4];
+  };
+
+  ivec2 viewport_size_;
+  std::vector<Vertex> vertices_;
+  Shader shader_;
+  Shader::UniformHandle viewport_uniform_;
+  Shader::UniformHandle font_uniform_;
+  Texture2D font_;
+  VertexArray vao_;
+  StreamBuffer stream_;
+
+  void Quad(float x, float y, float w, float h, float u, float v, float uw, float vh, fvec4 color);
+};
+
+}
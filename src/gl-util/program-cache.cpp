@@ -0,0 +1,146 @@
+#include "gl-util/program-cache.h"
+#include "util/binary-io.h"
+#include "util/mapped-file.h"
+#include <cerrno>
+#include <cstdio>
+#include <iostream>
+#include <sys/stat.h>
+#include <vector>
+using namespace std;
+
+namespace GL {
+
+static const char kMagic[8] = {'C', 'U', 'B', 'E', 'P', 'R', 'O', 'G'};
+static const uint32_t kVersion = 1;
+
+// FNV-1a.
+static uint64_t Hash(uint64_t h, const string& s) {
+  for (unsigned char c: s) {
+    h ^= c;
+    h *= 1099511628211ull;
+  }
+  // Separator, so that moving text between the strings changes the hash.
+  h ^= 0xff;
+  h *= 1099511628211ull;
+  return h;
+}
+
+ProgramBinaryCache::ProgramBinaryCache(const string& dir): dir_(dir) {
+  GLint formats = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);CHECK_GL_ERROR();
+  supported_ = formats > 0;
+  if (!supported_)
+    return;
+  for (size_t i = 1; i <= dir_.size(); ++i) {
+    if (i == dir_.size() || dir_[i] == '/') {
+      if (mkdir(dir_.substr(0, i).c_str(), 0755) && errno != EEXIST) {
+        cerr << "can't create shader cache directory " << dir_.substr(0, i) << endl;
+        supported_ = false;
+        return;
+      }
+    }
+  }
+}
+
+string ProgramBinaryCache::Driver() const {
+  string res;
+  for (GLenum name: {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+    const GLubyte* s = glGetString(name);CHECK_GL_ERROR();
+    res += (const char*)s;
+    res += '\n';
+  }
+  return res;
+}
+
+uint64_t ProgramBinaryCache::Key(const string& vert_text, const string& frag_text, const string& driver) const {
+  uint64_t h = 14695981039346656037ull;
+  h = Hash(h, vert_text);
+  h = Hash(h, frag_text);
+  return Hash(h, driver);
+}
+
+string ProgramBinaryCache::Path(uint64_t key) const {
+  char name[32];
+  snprintf(name, sizeof(name), "/%016llx.bin", (unsigned long long)key);
+  return dir_ + name;
+}
+
+bool ProgramBinaryCache::Load(const string& vert_text, const string& frag_text, GLuint program) {
+  if (!supported_)
+    return false;
+  string driver = Driver();
+  uint64_t key = Key(vert_text, frag_text, driver);
+  string path = Path(key);
+  struct stat st;
+  if (stat(path.c_str(), &st)) {
+    ++misses_;
+    return false;
+  }
+  try {
+    MappedFile file(path);
+    BinaryReader r(file.data(), file.size());
+    if (memcmp(r.Skip(sizeof(kMagic)), kMagic, sizeof(kMagic)) ||
+        r.Read<uint32_t>() != kVersion || r.Read<uint64_t>() != key)
+      throw IOException("wrong header");
+    uint32_t driver_size = r.Read<uint32_t>();
+    if (string(r.Skip(driver_size), driver_size) != driver)
+      throw IOException("different driver");
+    GLenum format = r.Read<uint32_t>();
+    uint32_t size = r.Read<uint32_t>();
+    const char* binary = r.Skip(size);
+    if (!r.AtEnd())
+      throw IOException("trailing data");
+    glProgramBinary(program, format, binary, size);
+    // The driver may refuse binaries, e.g. from a different build; that's reported
+    // as a failed link rather than an error.
+    while (glGetError() != GL_NO_ERROR) {}
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);CHECK_GL_ERROR();
+    if (!linked)
+      throw IOException("rejected by the driver");
+  } catch (IOException& e) {
+    cerr << "ignoring cached shader program " << path << ": " << e.what() << endl;
+    ++misses_;
+    return false;
+  }
+  ++hits_;
+  return true;
+}
+
+void ProgramBinaryCache::PrepareToLink(GLuint program) {
+  if (supported_) {
+    glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);CHECK_GL_ERROR();
+  }
+}
+
+void ProgramBinaryCache::Save(const string& vert_text, const string& frag_text, GLuint program) {
+  if (!supported_ || save_failed_)
+    return;
+  GLint size = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);CHECK_GL_ERROR();
+  if (size <= 0)
+    return;
+  vector<char> binary(size);
+  GLenum format;
+  glGetProgramBinary(program, size, &size, &format, binary.data());CHECK_GL_ERROR();
+
+  string driver = Driver();
+  uint64_t key = Key(vert_text, frag_text, driver);
+  BinaryWriter w;
+  w.WriteBytes(kMagic, sizeof(kMagic));
+  w.Write(kVersion);
+  w.Write(key);
+  w.Write<uint32_t>(driver.size());
+  w.WriteBytes(driver.data(), driver.size());
+  w.Write<uint32_t>(format);
+  w.Write<uint32_t>(size);
+  w.WriteBytes(binary.data(), size);
+  try {
+    WriteFileAtomically(Path(key), w.data().data(), w.size());
+  } catch (IOException& e) {
+    cerr << "can't write shader cache: " << e.what() << endl;
+    save_failed_ = true;
+  }
+}
+
+}
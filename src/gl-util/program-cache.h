@@ -0,0 +1,48 @@
+#pragma once
+#include "gl-util/gl-common.h"
+#include <string>
+
+namespace GL {
+
+// On-disk cache of linked shader programs (glGetProgramBinary), so that later launches
+// skip compiling and linking GLSL. Entries are keyed by a hash of the shader sources and
+// the driver's vendor, renderer and version strings, and are rejected on any mismatch,
+// e.g. after a driver update, in which case the program is just compiled again.
+// Does nothing if the driver supports no binary formats.
+//
+// Format of <dir>/<key>.bin: "CUBEPROG", uint32 version, uint64 key, uint32 driver string
+// length, driver string, uint32 binary format, uint32 binary length, binary. Host byte order.
+class ProgramBinaryCache {
+ public:
+  // Creates `dir` (and its parents) if needed. Failing to write the cache is logged, not thrown.
+  explicit ProgramBinaryCache(const std::string& dir);
+
+  // Loads the program linked from these sources into `program`, a new program object
+  // with no shaders attached. Returns false if it's not cached or the driver rejected it.
+  bool Load(const std::string& vert_text, const std::string& frag_text, GLuint program);
+  // Stores a successfully linked `program`. It should have been linked with
+  // GL_PROGRAM_BINARY_RETRIEVABLE_HINT, see PrepareToLink().
+  void Save(const std::string& vert_text, const std::string& frag_text, GLuint program);
+  // Call before glLinkProgram() on a program that will be saved.
+  void PrepareToLink(GLuint program);
+
+  size_t hits() const {
+    return hits_;
+  }
+  size_t misses() const {
+    return misses_;
+  }
+
+ private:
+  std::string dir_;
+  bool supported_ = false;
+  bool save_failed_ = false;
+  size_t hits_ = 0;
+  size_t misses_ = 0;
+
+  std::string Driver() const;
+  uint64_t Key(const std::string& vert_text, const std::string& frag_text, const std::string& driver) const;
+  std::string Path(uint64_t key) const;
+};
+
+}
@@ -1,4 +1,5 @@
 #include "shader.h"
+#include <algorithm>
 #include <string>
 #include <iostream>
 #include <fstream>
@@ -16,18 +17,18 @@ static void CompileShader(
   GLint ret;
   glGetShaderiv(shader, GL_COMPILE_STATUS, &ret);CHECK_GL_ERROR();
 
-  const int maxlen = 100000;
-  GLchar buffer[maxlen];
-  GLsizei l;
-  glGetShaderInfoLog(shader, maxlen, &l, buffer);CHECK_GL_ERROR();
+  GLint len = 0;
+  glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &len);CHECK_GL_ERROR();
+  string log(max(len, 1), '\0');
+  glGetShaderInfoLog(shader, log.size(), nullptr, &log[0]);CHECK_GL_ERROR();
 
-  if (!ret || buffer[0] != '\0') {
+  if (!ret || log[0] != '\0') {
     if (ret) {
       cerr << "compiled: " << name << "\n";
     } else {
       cerr << "compilation failed: " << name << "\n";
     }
-    cerr << buffer << "\n" << endl;
+    cerr << log.c_str() << "\n" << endl;
 
     if (!ret)
       throw ShaderCompilationException("compilation error in " + name);
@@ -38,38 +39,12 @@ Shader::Shader(
     const std::string &vert_name,
     const std::string &frag_name,
     const std::string &vert_text,
-    const std::string &frag_text) {
+    const std::string &frag_text,
+    ProgramBinaryCache *cache) {
   try {
-    GLint ret;
-
-    vs_ = glCreateShader(GL_VERTEX_SHADER);CHECK_GL_ERROR();
-    CompileShader(vs_, vert_name, vert_text);
-
-    ps_ = glCreateShader(GL_FRAGMENT_SHADER);CHECK_GL_ERROR();
-    CompileShader(ps_, frag_name, frag_text);
-
     program_ = glCreateProgram();CHECK_GL_ERROR();
-    glAttachShader(program_, vs_);CHECK_GL_ERROR();
-    glAttachShader(program_, ps_);CHECK_GL_ERROR();
-    glLinkProgram(program_);CHECK_GL_ERROR();
-
-    glGetProgramiv(program_, GL_LINK_STATUS, &ret);CHECK_GL_ERROR();
-
-    const int maxlen = 100000;
-    GLchar buffer[maxlen];
-    GLsizei l;
-    glGetProgramInfoLog(program_, maxlen, &l, buffer);CHECK_GL_ERROR();
-    if (!ret || buffer[0] != '\0'){
-      if (ret)
-        cerr << "linked: " << vert_name << " and " << frag_name << "\n";
-      else
-        cerr << "linking failed: " << vert_name << " and " << frag_name << "\n";
-      cerr << buffer << "\n" << endl;
-
-      if (!ret)
-        throw ShaderCompilationException(
-          "linking error in " + vert_name + " and " + frag_name);
-    }
+    if (!cache || !cache->Load(vert_text, frag_text, program_))
+      CompileAndLink(vert_name, frag_name, vert_text, frag_text, cache);
 
     int cnt;
     glGetProgramiv(program_, GL_ACTIVE_UNIFORMS, &cnt);CHECK_GL_ERROR();
@@ -81,11 +56,14 @@ Shader::Shader(
         program_, i, GL_ACTIVE_UNIFORM_MAX_LENGTH,
         &namelen, &uni.size, &uni.type, name);CHECK_GL_ERROR();
       uni.location = glGetUniformLocation(program_, name);CHECK_GL_ERROR();
+      uni.name = name;
       uniforms_[name] = uni;
     }
   } catch (...) {
-    if (program_) {
+    if (program_ && vs_) {
       glDetachShader(program_, vs_);CHECK_GL_ERROR();
+    }
+    if (program_ && ps_) {
       glDetachShader(program_, ps_);CHECK_GL_ERROR();
     }
     if (vs_) {
@@ -100,6 +78,48 @@ Shader::Shader(
     throw;
   }
 }
+
+void Shader::CompileAndLink(
+    const std::string &vert_name,
+    const std::string &frag_name,
+    const std::string &vert_text,
+    const std::string &frag_text,
+    ProgramBinaryCache *cache) {
+  GLint ret;
+
+  vs_ = glCreateShader(GL_VERTEX_SHADER);CHECK_GL_ERROR();
+  CompileShader(vs_, vert_name, vert_text);
+
+  ps_ = glCreateShader(GL_FRAGMENT_SHADER);CHECK_GL_ERROR();
+  CompileShader(ps_, frag_name, frag_text);
+
+  glAttachShader(program_, vs_);CHECK_GL_ERROR();
+  glAttachShader(program_, ps_);CHECK_GL_ERROR();
+  if (cache)
+    cache->PrepareToLink(program_);
+  glLinkProgram(program_);CHECK_GL_ERROR();
+
+  glGetProgramiv(program_, GL_LINK_STATUS, &ret);CHECK_GL_ERROR();
+
+  GLint len = 0;
+  glGetProgramiv(program_, GL_INFO_LOG_LENGTH, &len);CHECK_GL_ERROR();
+  string log(max(len, 1), '\0');
+  glGetProgramInfoLog(program_, log.size(), nullptr, &log[0]);CHECK_GL_ERROR();
+  if (!ret || log[0] != '\0'){
+    if (ret)
+      cerr << "linked: " << vert_name << " and " << frag_name << "\n";
+    else
+      cerr << "linking failed: " << vert_name << " and " << frag_name << "\n";
+    cerr << log.c_str() << "\n" << endl;
+
+    if (!ret)
+      throw ShaderCompilationException(
+        "linking error in " + vert_name + " and " + frag_name);
+  }
+
+  if (cache)
+    cache->Save(vert_text, frag_text, program_);
+}
 void Shader::Use() {
   glUseProgram(program_);CHECK_GL_ERROR();
 }
@@ -115,45 +135,71 @@ void Shader::LogUniforms() {
   cerr << endl;
 }
 
-const Shader::Uniform* Shader::GetUniformLocation(
-    const std::string &name, GLenum type) {
-  return GetUniformLocation(name, type, type);
-}
-
-const Shader::Uniform* Shader::GetUniformLocation(
-    const std::string &name, GLenum type1, GLenum type2) {
-  auto it = uniforms_.find(name); \
-  if (it == uniforms_.end()) { \
-    if (!uniform_errors_.count(name)) { \
-      uniform_errors_.insert(name); \
+Shader::UniformHandle Shader::GetUniform(const std::string &name) {
+  auto it = uniforms_.find(name);
+  if (it == uniforms_.end()) {
+    if (!uniform_errors_.count(name)) {
+      uniform_errors_.insert(name);
       std::cerr << "trying to assign a non-existing or unused uniform " << name
         << std::endl;
     }
-    return nullptr;
+    return UniformHandle();
   }
-  const Shader::Uniform &res = it->second;
-  if (res.type != type1 && res.type != type2) {
-    if (!uniform_errors_.count(name)) { \
-      uniform_errors_.insert(name); \
-      std::cerr << "trying to assign value of wrong type to uniform " << name
+  return UniformHandle(&it->second);
+}
+
+const Shader::Uniform* Shader::CheckType(UniformHandle uni, GLenum type) {
+  return CheckType(uni, type, type);
+}
+
+const Shader::Uniform* Shader::CheckType(
+    UniformHandle uni, GLenum type1, GLenum type2) {
+  const Uniform *res = uni.uniform_;
+  if (!res)
+    return nullptr;
+  if (res->type != type1 && res->type != type2) {
+    if (!uniform_errors_.count(res->name)) {
+      uniform_errors_.insert(res->name);
+      std::cerr << "trying to assign value of wrong type to uniform " << res->name
         << std::endl;
     }
     return nullptr;
   }
 
-  return &res;
+  return res;
 }
 
 void Shader::SetTexture(
   const std::string &name, const Texture2D &texture, int unit
 ) {
-  auto *uni = GetUniformLocation(name, GL_SAMPLER_2D);
+  SetTexture(GetUniform(name), texture, unit);
+}
+void Shader::SetScalar(const std::string &name, double value) {
+  SetScalar(GetUniform(name), value);
+}
+void Shader::SetVec2(const std::string &name, dvec2 value) {
+  SetVec2(GetUniform(name), value);
+}
+void Shader::SetVec3(const std::string &name, dvec3 value) {
+  SetVec3(GetUniform(name), value);
+}
+void Shader::SetVec4(const std::string &name, dvec4 value) {
+  SetVec4(GetUniform(name), value);
+}
+void Shader::SetMat4(const std::string &name, const fmat4 &value) {
+  SetMat4(GetUniform(name), value);
+}
+
+void Shader::SetTexture(
+  UniformHandle handle, const Texture2D &texture, int unit
+) {
+  auto *uni = CheckType(handle, GL_SAMPLER_2D);
   if (uni)
     texture.AssignToUniform(uni->location, unit);
 }
 
-void Shader::SetScalar(const std::string &name, double value) {
-  auto *uni = GetUniformLocation(name, GL_FLOAT, GL_DOUBLE);
+void Shader::SetScalar(UniformHandle handle, double value) {
+  auto *uni = CheckType(handle, GL_FLOAT, GL_DOUBLE);
   if (uni) {
     if (uni->type == GL_FLOAT) {
       glUniform1f(uni->location, static_cast<float>(value)); CHECK_GL_ERROR();
@@ -163,8 +209,8 @@ void Shader::SetScalar(const std::string &name, double value) {
   }
 }
 
-void Shader::SetVec2(const std::string &name, dvec2 value) {
-  auto *uni = GetUniformLocation(name, GL_FLOAT_VEC2, GL_DOUBLE_VEC2);
+void Shader::SetVec2(UniformHandle handle, dvec2 value) {
+  auto *uni = CheckType(handle, GL_FLOAT_VEC2, GL_DOUBLE_VEC2);
   if (uni) {
     if (uni->type == GL_FLOAT_VEC2) {
       glUniform2f(uni->location, (float)value.x, (float)value.y); CHECK_GL_ERROR();
@@ -174,8 +220,8 @@ void Shader::SetVec2(const std::string &name, dvec2 value) {
   }
 }
 
-void Shader::SetVec3(const std::string &name, dvec3 value) {
-  auto *uni = GetUniformLocation(name, GL_FLOAT_VEC3, GL_DOUBLE_VEC3);
+void Shader::SetVec3(UniformHandle handle, dvec3 value) {
+  auto *uni = CheckType(handle, GL_FLOAT_VEC3, GL_DOUBLE_VEC3);
   if (uni) {
     if (uni->type == GL_FLOAT_VEC3) {
       glUniform3f(uni->location, (float)value.x, (float)value.y, (float)value.z); CHECK_GL_ERROR();
@@ -185,8 +231,8 @@ void Shader::SetVec3(const std::string &name, dvec3 value) {
   }
 }
 
-void Shader::SetVec4(const std::string &name, dvec4 value) {
-  auto *uni = GetUniformLocation(name, GL_FLOAT_VEC4, GL_DOUBLE_VEC4);
+void Shader::SetVec4(UniformHandle handle, dvec4 value) {
+  auto *uni = CheckType(handle, GL_FLOAT_VEC4, GL_DOUBLE_VEC4);
   if (uni) {
     if (uni->type == GL_FLOAT_VEC4) {
       glUniform4f(uni->location, (float)value.x, (float)value.y, (float)value.z, (float)value.w);
@@ -198,17 +244,32 @@ void Shader::SetVec4(const std::string &name, dvec4 value) {
   }
 }
 
-void Shader::SetMat4(const std::string &name, const fmat4 &value) {
-  auto *uni = GetUniformLocation(name, GL_FLOAT_MAT4);
+void Shader::SetMat4(UniformHandle handle, const fmat4 &value) {
+  auto *uni = CheckType(handle, GL_FLOAT_MAT4);
   if (uni)
     glUniformMatrix4fv(uni->location, 1, true, value.m);
 }
 
+void Shader::BindUniformBlock(const std::string &block, GLuint binding) {
+  GLuint idx = glGetUniformBlockIndex(program_, block.c_str());CHECK_GL_ERROR();
+  if (idx == GL_INVALID_INDEX) {
+    std::cerr << "trying to bind a non-existing or unused uniform block " << block
+      << std::endl;
+    return;
+  }
+  glUniformBlockBinding(program_, idx, binding);CHECK_GL_ERROR();
+}
+
 Shader::~Shader() {
-  glDetachShader(program_, vs_);
-  glDetachShader(program_, ps_);
-  glDeleteShader(vs_);
-  glDeleteShader(ps_);
+  // No shaders if the program came from ProgramBinaryCache.
+  if (vs_) {
+    glDetachShader(program_, vs_);
+    glDeleteShader(vs_);
+  }
+  if (ps_) {
+    glDetachShader(program_, ps_);
+    glDeleteShader(ps_);
+  }
   glDeleteProgram(program_);
 }
 
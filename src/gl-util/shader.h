@@ -1,6 +1,7 @@
 #pragma once
 
 #include "gl-common.h"
+#include "program-cache.h"
 #include "texture2d.h"
 #include "util/vec.h"
 #include "util/mat.h"
@@ -20,12 +21,47 @@ public:
     const std::string &vert_name, // For logging and exception messages only.
     const std::string &frag_name, // For logging and exception messages only.
     const std::string &vert_text,
-    const std::string &frag_text);
+    const std::string &frag_text,
+    // If given, the linked program is loaded from or saved to this cache. Not owned.
+    ProgramBinaryCache *cache = nullptr);
   ~Shader();
 
+private:
+  struct Uniform {
+    std::string name;
+    GLint location;
+    GLint size;
+    GLenum type;
+  };
+
+public:
+  // A uniform resolved once with GetUniform(), for setting it every frame
+  // without building strings and looking up names. Valid while the shader is alive.
+  class UniformHandle {
+  public:
+    UniformHandle() {}
+    bool valid() const { return uniform_ != nullptr; }
+  private:
+    friend class Shader;
+    explicit UniformHandle(const Uniform *uniform): uniform_(uniform) {}
+    const Uniform *uniform_ = nullptr;
+  };
+
+  // Returns invalid handle (and logs once) if the uniform doesn't exist.
+  // Setting an invalid handle does nothing.
+  UniformHandle GetUniform(const std::string &name);
+
   // Setting uniforms. Float and double are interchangeable.
   // If the uniform doesn't exist or the type is incorrect, logs and doesn't
   // throw. Logs only once for each name to avoid flooding the log.
+  void SetTexture(UniformHandle uni, const Texture2D &texture, int unit);
+  void SetScalar(UniformHandle uni, double value);
+  void SetVec2(UniformHandle uni, dvec2 value);
+  void SetVec3(UniformHandle uni, dvec3 value);
+  void SetVec4(UniformHandle uni, dvec4 value);
+  void SetMat4(UniformHandle uni, const fmat4 &value);
+
+  // Same by name: a lookup in a map each time. Fine for setup code, avoid in per-frame loops.
   void SetTexture(const std::string &name, const Texture2D &texture, int unit);
   void SetScalar(const std::string &name, double value);
   void SetVec2(const std::string &name, dvec2 value);
@@ -33,16 +69,14 @@ public:
   void SetVec4(const std::string &name, dvec4 value);
   void SetMat4(const std::string &name, const fmat4 &value);
 
+  // Makes the uniform block `block` read from the buffer bound to `binding`
+  // (see UniformBuffer::Bind()). Logs if there's no such block.
+  void BindUniformBlock(const std::string &block, GLuint binding);
+
   void Use();
   GLuint program_id();
   void LogUniforms(); // writes information about all active uniforms to stdout
 private:
-  struct Uniform {
-    GLint location;
-    GLint size;
-    GLenum type;
-  };
-
   GLuint vs_{};
   GLuint ps_{};
   GLuint program_{};
@@ -51,8 +85,14 @@ private:
   // For what uniforms we already logged an error.
   std::set<std::string> uniform_errors_;
 
-  const Uniform* GetUniformLocation(const std::string &name, GLenum type);
-  const Uniform* GetUniformLocation(const std::string &name, GLenum type1, GLenum type2);
+  void CompileAndLink(
+    const std::string &vert_name,
+    const std::string &frag_name,
+    const std::string &vert_text,
+    const std::string &frag_text,
+    ProgramBinaryCache *cache);
+  const Uniform* CheckType(UniformHandle uni, GLenum type);
+  const Uniform* CheckType(UniformHandle uni, GLenum type1, GLenum type2);
 };
 
 }
@@ -0,0 +1,109 @@
+#include "gl-util/stream-buffer.h"
+#include "util/exceptions.h"
+#include <algorithm>
+
+// ARB_buffer_storage (GL 4.4) is newer than the bundled gl3w, so it's loaded here.
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+typedef void (APIENTRYP BufferStorageProc)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+static BufferStorageProc buffer_storage;
+
+namespace GL {
+
+StreamBuffer::StreamBuffer(size_t region_size, int regions, bool persistent)
+    : regions_(regions), persistent_(persistent && HasExtension("GL_ARB_buffer_storage")) {
+  if (regions < 1 || regions > (int)(sizeof(fences_) / sizeof(fences_[0])))
+    throw GLException("unsupported number of stream buffer regions");
+  if (persistent_ && !buffer_storage)
+    buffer_storage = (BufferStorageProc)gl3wGetProcAddress("glBufferStorage");
+  persistent_ = persistent_ && buffer_storage;
+  Allocate(region_size);
+}
+
+StreamBuffer::~StreamBuffer() {
+  Release();
+  SOFT_CHECK_GL_ERROR();
+}
+
+void StreamBuffer::Allocate(size_t region_size) {
+  // Keeps every region aligned for any attribute type.
+  region_size_ = std::max<size_t>((region_size + 255) & ~(size_t)255, 256);
+  glGenBuffers(1, &buffer_);CHECK_GL_ERROR();
+  glBindBuffer(GL_ARRAY_BUFFER, buffer_);CHECK_GL_ERROR();
+  if (persistent_) {
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    buffer_storage(GL_ARRAY_BUFFER, region_size_ * regions_, nullptr, flags);CHECK_GL_ERROR();
+    mapped_ = (char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, region_size_ * regions_, flags);CHECK_GL_ERROR();
+  } else {
+    glBufferData(GL_ARRAY_BUFFER, region_size_, nullptr, GL_STREAM_DRAW);CHECK_GL_ERROR();
+  }
+}
+
+void StreamBuffer::Release() {
+  for (GLsync& f: fences_) {
+    if (f) {
+      glDeleteSync(f);
+      f = nullptr;
+    }
+  }
+  if (mapped_) {
+    glBindBuffer(GL_ARRAY_BUFFER, buffer_);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+    mapped_ = nullptr;
+  }
+  glDeleteBuffers(1, &buffer_);
+  buffer_ = 0;
+}
+
+void* StreamBuffer::Begin(size_t size) {
+  if (!persistent_) {
+    glBindBuffer(GL_ARRAY_BUFFER, buffer_);CHECK_GL_ERROR();
+    region_size_ = std::max(region_size_, std::max<size_t>(size, 1));
+    // New storage for this frame; the old one lives on until draws that use it are done,
+    // so mapping it needs no synchronization.
+    glBufferData(GL_ARRAY_BUFFER, region_size_, nullptr, GL_STREAM_DRAW);CHECK_GL_ERROR();
+    void* p = glMapBufferRange(GL_ARRAY_BUFFER, 0, region_size_, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);CHECK_GL_ERROR();
+    return p;
+  }
+
+  // Everything submitted since the previous Begin(), including draws reading the
+  // previous region, must finish before that region is written again.
+  if (current_ >= 0) {
+    fences_[current_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);CHECK_GL_ERROR();
+  }
+  if (size > region_size_) {
+    glFinish();
+    Release();
+    Allocate(std::max(size, region_size_ * 2));
+    current_ = -1;
+  }
+  current_ = (current_ + 1) % regions_;
+  GLsync& fence = fences_[current_];
+  if (fence) {
+    GLenum res = glClientWaitSync(fence, 0, 0);
+    if (res == GL_TIMEOUT_EXPIRED) {
+      ++stalls_;
+      res = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+    }
+    if (res == GL_WAIT_FAILED)
+      throw GLException("glClientWaitSync failed");
+    glDeleteSync(fence);
+    fence = nullptr;
+  }
+  return mapped_ + current_ * region_size_;
+}
+
+size_t StreamBuffer::End() {
+  if (!persistent_) {
+    glBindBuffer(GL_ARRAY_BUFFER, buffer_);CHECK_GL_ERROR();
+    if (!glUnmapBuffer(GL_ARRAY_BUFFER))
+      throw GLException("stream buffer contents were lost");
+    return 0;
+  }
+  // Coherent mapping: the writes are visible to commands issued from now on.
+  return current_ * region_size_;
+}
+
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include "gl-util/gl-common.h"
+
+namespace GL {
+
+// Buffer for data rewritten every frame, e.g. per-instance transforms.
+//
+// With ARB_buffer_storage (core in 4.4) the buffer is mapped once, persistently and coherently,
+// and split into `regions` parts used in turn; a fence per part makes Begin() wait only if
+// the GPU is still reading the part from `regions` frames ago. The CPU writes straight into
+// the driver's memory, with no copies and no implicit synchronization.
+// Otherwise falls back to orphaning: the buffer storage is respecified and mapped every frame.
+//
+//   void* p = stream.Begin(size);
+//   ...write `size` bytes to p...
+//   size_t offset = stream.End();
+//   ...draw with stream.buffer() at offset...
+class StreamBuffer {
+ public:
+  // `region_size` is the initial capacity per frame; Begin() grows it if needed.
+  // `persistent` = false forces the fallback path.
+  explicit StreamBuffer(size_t region_size, int regions = 3, bool persistent = true);
+  ~StreamBuffer();
+
+  StreamBuffer(const StreamBuffer& rhs) = delete;
+  StreamBuffer& operator=(const StreamBuffer& rhs) = delete;
+
+  // Returns memory for this frame's `size` bytes. Write-only; valid until End().
+  void* Begin(size_t size);
+  // Returns the offset of the written data in buffer().
+  size_t End();
+
+  GLuint buffer() const {
+    return buffer_;
+  }
+  bool persistent() const {
+    return persistent_;
+  }
+  // Number of times Begin() had to wait for the GPU to finish with a region.
+  size_t stalls() const {
+    return stalls_;
+  }
+
+ private:
+  size_t region_size_;
+  int regions_;
+  bool persistent_;
+  GLuint buffer_ = 0;
+  char* mapped_ = nullptr; // persistent only
+  GLsync fences_[8] = {};
+  int current_ = -1;
+  size_t stalls_ = 0;
+
+  void Allocate(size_t region_size);
+  void Release();
+};
+
+}
@@ -0,0 +1,28 @@
+#include "gl-util/uniform-buffer.h"
+#include "util/exceptions.h"
+
+namespace GL {
+
+UniformBuffer::UniformBuffer(size_t size): size_(size) {
+  glGenBuffers(1, &ubo_);CHECK_GL_ERROR();
+  glBindBuffer(GL_UNIFORM_BUFFER, ubo_);CHECK_GL_ERROR();
+  glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_STREAM_DRAW);CHECK_GL_ERROR();
+}
+UniformBuffer::~UniformBuffer() {
+  glDeleteBuffers(1, &ubo_);
+  CHECK_GL_ERROR();
+}
+
+void UniformBuffer::SetData(const void* data, size_t size) {
+  if (size != size_)
+    throw GLException("uniform buffer size mismatch");
+  glBindBuffer(GL_UNIFORM_BUFFER, ubo_);CHECK_GL_ERROR();
+  // Orphan the old storage so that we don't wait for draws still reading it.
+  glBufferData(GL_UNIFORM_BUFFER, size, data, GL_STREAM_DRAW);CHECK_GL_ERROR();
+}
+
+void UniformBuffer::Bind(GLuint binding) {
+  glBindBufferBase(GL_UNIFORM_BUFFER, binding, ubo_);CHECK_GL_ERROR();
+}
+
+}
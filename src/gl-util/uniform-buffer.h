@@ -0,0 +1,39 @@
+#pragma once
+#include "gl-util/gl-common.h"
+
+namespace GL {
+
+// A buffer object backing a uniform block, for values shared by all draws in a frame.
+// The C++ struct passed to Set() must match the std140 layout of the block.
+//   layout(std140) uniform Frame { ... };
+//   shader.BindUniformBlock("Frame", 0);
+//   buffer.Set(frame);
+//   buffer.Bind(0);
+class UniformBuffer {
+ public:
+  explicit UniformBuffer(size_t size);
+  ~UniformBuffer();
+
+  UniformBuffer(const UniformBuffer& rhs) = delete;
+  UniformBuffer& operator=(const UniformBuffer& rhs) = delete;
+
+  // Replaces the whole contents; `size` must be the size passed to the constructor.
+  void SetData(const void* data, size_t size);
+  template<typename T>
+  void Set(const T& data) {
+    SetData(&data, sizeof(T));
+  }
+
+  // Binds to uniform buffer binding point `binding`.
+  void Bind(GLuint binding);
+
+  size_t size() const {
+    return size_;
+  }
+
+ private:
+  size_t size_;
+  GLuint ubo_;
+};
+
+}
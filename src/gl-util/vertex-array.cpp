@@ -30,7 +30,22 @@ void VertexArray::AddAttributes(size_t count, const Attribute* attrs, GLint tota
     const Attribute& a = attrs[i];
     glEnableVertexAttribArray(a.index);CHECK_GL_ERROR();
     glVertexAttribPointer(a.index, a.components, a.type, a.normalized, a.stride, (void*)a.offset);CHECK_GL_ERROR();
+    if (a.divisor) {
+      glVertexAttribDivisor(a.index, a.divisor);CHECK_GL_ERROR();
+    }
   }
+  glBindVertexArray(0);CHECK_GL_ERROR();
+}
+
+void VertexArray::SetAttributes(const Format& format, GLuint buffer, size_t offset) {
+  glBindVertexArray(vao_);CHECK_GL_ERROR();
+  glBindBuffer(GL_ARRAY_BUFFER, buffer);CHECK_GL_ERROR();
+  for (const Attribute& a: format.attributes) {
+    glEnableVertexAttribArray(a.index);CHECK_GL_ERROR();
+    glVertexAttribPointer(a.index, a.components, a.type, a.normalized, a.stride, (void*)(offset + a.offset));CHECK_GL_ERROR();
+    glVertexAttribDivisor(a.index, a.divisor);CHECK_GL_ERROR();
+  }
+  glBindVertexArray(0);CHECK_GL_ERROR();
 }
 
 void VertexArray::Draw() {
@@ -39,4 +54,10 @@ void VertexArray::Draw() {
   glBindVertexArray(0);CHECK_GL_ERROR();
 }
 
+void VertexArray::Draw(size_t first, size_t count) {
+  glBindVertexArray(vao_);CHECK_GL_ERROR();
+  glDrawArrays(GL_TRIANGLES, first, count);CHECK_GL_ERROR();
+  glBindVertexArray(0);CHECK_GL_ERROR();
+}
+
 }
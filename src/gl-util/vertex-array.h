@@ -14,12 +14,33 @@ class VertexArray {
     bool normalized = false;
     size_t stride = 0;
     size_t offset = 0;
+    // 0 for per-vertex attributes, N to advance once every N instances in instanced draws.
+    GLuint divisor = 0;
 
     Attribute() = default;
     Attribute(GLuint index, GLint components, GLenum type, size_t stride = 0, size_t offset = 0)
       : index(index), components(components), type(type), stride(stride), offset(offset) {}
   };
 
+  // Layout of an interleaved vertex struct, from which attributes are generated:
+  //   VertexArray::Format format(sizeof(V));
+  //   format.Add(0, 3, GL_FLOAT, offsetof(V, pos))
+  //         .Add(1, 4, GL_INT_2_10_10_10_REV, offsetof(V, normal), true);
+  //   vao.SetAttributes(format, buffer, offset);
+  struct Format {
+    size_t stride;
+    GLuint divisor; // see Attribute::divisor
+    std::vector<Attribute> attributes;
+
+    explicit Format(size_t stride, GLuint divisor = 0): stride(stride), divisor(divisor) {}
+    Format& Add(GLuint index, GLint components, GLenum type, size_t offset, bool normalized = false) {
+      attributes.emplace_back(index, components, type, stride, offset);
+      attributes.back().normalized = normalized;
+      attributes.back().divisor = divisor;
+      return *this;
+    }
+  };
+
   // Initially vertices have no attributes (not even position),
   // so vertex array is pretty useless until you call AddAttribute().
   VertexArray(size_t vertices);
@@ -40,7 +61,13 @@ class VertexArray {
   // A more general interface. Adds one buffer object containing `count` attributes described by `attrs`.
   void AddAttributes(size_t count, const Attribute* attrs, GLint total_bytes, const void* data);
 
+  // Sources attributes described by `format` from a buffer not owned by this vertex array
+  // (e.g. a StreamBuffer), starting at byte `offset`. Can be called again to move them.
+  void SetAttributes(const Format& format, GLuint buffer, size_t offset);
+
   void Draw();
+  // Draws `count` vertices from `first` on; for buffers filled every frame.
+  void Draw(size_t first, size_t count);
 
  private:
   size_t vertices_;
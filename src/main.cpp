@@ -1,16 +1,52 @@
 #include <iostream>
+#include <cctype>
+#include <cstring>
 #include "gl-util/glfw-util.h"
+#include "gl-util/async-readback.h"
+#ifdef HAVE_EGL
+#include "gl-util/egl-util.h"
+#endif
+#include "util/exceptions.h"
 #include "util/stopwatch.h"
+#include "util/frame-pacer.h"
+#include "util/image-sequence-writer.h"
 #include "util/quat.h"
 #include "sim/scene.h"
+#include "sim/recording.h"
+#include "sim/snapshot.h"
+#include "sim/trajectory.h"
+#include "sim/physics-thread.h"
+#include "sim/hud.h"
 using namespace std;
 
 static void LogGLFWError(int code, const char *message) {
   std::cerr << "glfw error " << code << ": " << message << std::endl;
 }
 
+// $XDG_CACHE_HOME/cube or ~/.cache/cube; empty if neither variable is set.
+static string DefaultShaderCacheDir() {
+  if (const char* dir = getenv("XDG_CACHE_HOME"))
+    return string(dir) + "/cube";
+  if (const char* home = getenv("HOME"))
+    return string(home) + "/.cache/cube";
+  return "";
+}
+
 static glfw::Window* window;
 static size_t frame_idx;
+// Sum over frames since the last title update of the time from the end of the physics step
+// whose state was drawn to the return from SwapBuffers(). Doesn't include the display's own latency.
+static double physics_latency_sum;
+// Same for the time from sampling the newest input that the drawn physics state reflects.
+static double input_latency_sum;
+static size_t input_latency_frames;
+static bool snapshot_requested;
+static bool hud_visible = true;
+
+// Trajectory playback controls.
+static bool play_paused;
+static double play_speed = 1; // negative - backwards
+static bool play_rewind;
 
 static void KeyCallback(
     GLFWwindow* w, int key, int scancode, int action, int mods) {
@@ -18,6 +54,24 @@ static void KeyCallback(
     if (key == GLFW_KEY_ESCAPE) {
       window->SetShouldClose();
     }
+    if (key == 'C') {
+      snapshot_requested = true;
+    }
+    if (key == 'H') {
+      hud_visible = !hud_visible;
+    }
+    if (key == GLFW_KEY_SPACE) {
+      play_paused = !play_paused;
+    }
+    if (key == GLFW_KEY_RIGHT) {
+      play_speed = play_speed < 0 ? 1 : play_speed * 2;
+    }
+    if (key == GLFW_KEY_LEFT) {
+      play_speed = play_speed > 0 ? -1 : play_speed * 2;
+    }
+    if (key == GLFW_KEY_HOME) {
+      play_rewind = true;
+    }
   }
 }
 
@@ -43,11 +97,70 @@ static void UpdateFPS() {
       fps_stopwatch.TimeSinceRestart() > period_seconds) {
     double fps = (frame_idx - last_update_frame)
       / fps_stopwatch.Restart();
+    double latency = physics_latency_sum / (frame_idx - last_update_frame);
+    double input_latency = input_latency_frames ? input_latency_sum / input_latency_frames : 0;
+    physics_latency_sum = 0;
+    input_latency_sum = 0;
+    input_latency_frames = 0;
     last_update_frame = frame_idx;
-    window->SetTitle("FPS: " + std::to_string(fps));
+    window->SetTitle("FPS: " + std::to_string(fps) + ", physics->present: " + std::to_string(latency * 1e3) + " ms"
+                     + ", input->present: " + std::to_string(input_latency * 1e3) + " ms");
   }
 }
 
+// HUD graphs of frame time, physics stats and constraint leak rates. H toggles it.
+class StatsHud {
+ public:
+  StatsHud() {
+    frame_ = hud_.AddGraph("frame", "ms", 33);
+    input_ = hud_.AddGraph("input->present", "ms", 50);
+    physics_ = hud_.AddGraph("physics step", "ms", 8);
+    solver_ = hud_.AddGraph("solver", "ms", 4);
+    substeps_ = hud_.AddGraph("substeps", "/frame", 200);
+    system_ = hud_.AddGraph("system", "eqs", 1);
+    leaks_[0] = hud_.AddGraph("leak pos", "m/s", 1e-6);
+    leaks_[1] = hud_.AddGraph("leak rot", "rad/s", 1e-6);
+    leaks_[2] = hud_.AddGraph("leak vel", "m/s2", 1e-6);
+    leaks_[3] = hud_.AddGraph("leak ang", "rad/s2", 1e-6);
+  }
+
+  // `physics` is null during playback. `input_latency` is of the previous frame.
+  void Update(double dt, const PhysicsThread* physics, double input_latency) {
+    hud_.Push(frame_, dt * 1e3);
+    if (!physics)
+      return;
+    hud_.Push(input_, input_latency * 1e3);
+    const PhysicsThread::Frame& f = physics->frame();
+    double leaked[4] = {f.leaked_translation, f.leaked_rotation, f.leaked_velocity, f.leaked_angular_velocity};
+    if (last_time_ >= 0 && f.time > last_time_) {
+      hud_.Push(physics_, f.step_seconds * 1e3);
+      hud_.Push(solver_, f.solver_seconds * 1e3);
+      hud_.Push(system_, f.system_size);
+      for (int i = 0; i < 4; ++i)
+        hud_.Push(leaks_[i], (leaked[i] - last_leaked_[i]) / (f.time - last_time_));
+    }
+    if (last_time_ >= 0)
+      hud_.Push(substeps_, f.substeps - last_substeps_);
+    last_time_ = f.time;
+    last_substeps_ = f.substeps;
+    copy(leaked, leaked + 4, last_leaked_);
+  }
+
+  void Render(ivec2 viewport_size) {
+    hud_.visible = hud_visible;
+    hud_.Render(viewport_size);
+  }
+
+ private:
+  Hud hud_;
+  int frame_, input_, physics_, solver_, substeps_, system_;
+  int leaks_[4];
+  // Totals at the previous Update(), for rates.
+  double last_time_ = -1;
+  size_t last_substeps_ = 0;
+  double last_leaked_[4] = {};
+};
+
 // Order of keys is: forward, backwards, left, right, up, down (-z, +z, -x, +x, +y, -y), ALL CAPS.
 dvec3 ThreeDofInput(glfw::Window& w, const char* keys) {
   dvec3 r = {0, 0, 0};
@@ -70,15 +183,193 @@ double rnd() {
   return (((rand()+.5)/(RAND_MAX+1.)+rand())/(RAND_MAX+1.)+rand())/(RAND_MAX+1.);
 }
 
-int main() {
+// Returns the box that the user controls.
+static Body* BuildScene(Scene& scene) {
+  //Body* table = scene.AddBody(MakeBox(dvec3(3, .1, 3)));
+  //table->pos.y = -.05;
+  //scene.AddConstraint(-1, table->idx, dvec3(0, 0, 0), dquat(1, 0, 0, 0), Constraint::DOF::POS | Constraint::DOF::ROT);
+
+  Body* box = scene.AddBody(MakeBox(dvec3(.06,.06,.06)).MultiplyMass(1000));
+  box->pos = dvec3(.03, .03, 0);
+
+  scene.AddConstraint(-1, box->idx, dvec3(-.03, -.03, -.03), dquat(1, 0, 0, 0), Constraint::DOF::POS | Constraint::DOF::RX | Constraint::DOF::RY);
+
+  scene.gravity = dvec3(0, -9.8, 0);
+
+  return box;
+}
+
+// Re-runs a session recorded with --record, without a window and as fast as possible.
+static int Replay(const string& path, const string& trajectory_path) {
+  Scene scene;
+  BuildScene(scene);
+  InputReplayer replayer(path);
+  unique_ptr<TrajectoryWriter> trajectory;
+  if (!trajectory_path.empty()) {
+    trajectory.reset(new TrajectoryWriter(trajectory_path, scene.bodies.size()));
+    scene.trajectory_sink = trajectory.get();
+  }
+  Stopwatch stopwatch;
+  bool same = replayer.Run(scene);
+  double t = stopwatch.TimeSinceRestart();
+  if (trajectory)
+    trajectory->Finish();
+  cerr << "replayed " << replayer.steps() << " steps in " << t << " s (" << replayer.steps() / t << " steps/s); "
+       << "final state " << (same ? "matches" : "DOESN'T MATCH") << " the recording" << endl;
+  return same ? 0 : 1;
+}
+
+// Whether `pattern` is safe as ImageSequenceWriter's printf format: exactly one conversion of an
+// int (flags, width and precision allowed, no `*` or length modifiers), and otherwise only %%.
+static bool IsFramePattern(const string& pattern) {
+  int conversions = 0;
+  for (size_t i = 0; i < pattern.size(); ++i) {
+    if (pattern[i] != '%')
+      continue;
+    if (++i < pattern.size() && pattern[i] == '%')
+      continue;
+    while (i < pattern.size() && strchr("-+ #0", pattern[i]))
+      ++i;
+    while (i < pattern.size() && isdigit((unsigned char)pattern[i]))
+      ++i;
+    if (i < pattern.size() && pattern[i] == '.')
+      for (++i; i < pattern.size() && isdigit((unsigned char)pattern[i]); ++i) {}
+    if (i == pattern.size() || !strchr("diouxX", pattern[i]))
+      return false;
+    ++conversions;
+  }
+  return conversions == 1;
+}
+
+// Renders a trajectory file to numbered images at `fps` frames per simulated second,
+// without a window or display (e.g. with Mesa's software rasterizer).
+static int RenderFrames(const string& play_path, const string& pattern, double fps, ivec2 size,
+                        bool gl_debug, const string& shader_cache_dir) {
+#ifdef HAVE_EGL
+  egl::HeadlessWindow window(size, gl_debug);
+  GL::LogInfo();
+  GL::EnableDebugOutput(gl_debug);
+  unique_ptr<GL::ProgramBinaryCache> shader_cache;
+  if (!shader_cache_dir.empty())
+    shader_cache.reset(new GL::ProgramBinaryCache(shader_cache_dir));
+
+  Scene scene;
+  scene.program_cache = shader_cache.get();
+  Body* box = BuildScene(scene);
+  scene.camera.pos = fvec3(-.1, .12, .15);
+  scene.camera.LookAt(box->pos);
+  scene.camera.aspect_ratio = (float)size.x / size.y;
+
+  TrajectoryReader trajectory(play_path);
+  if (trajectory.bodies() != scene.bodies.size())
+    throw IOException("trajectory " + play_path + " has a different number of bodies than the scene");
+  vector<BodyState> states(trajectory.bodies());
+
+  // Frame N+2 is being rendered while frame N is copied to a pixel buffer and frame N-1 is encoded.
+  GL::AsyncReadback readback(size);
+  ImageSequenceWriter writer(pattern, size);
+  auto consume = [&](uint64_t, const uint8_t* pixels) {
+                   writer.Write(pixels);
+                 };
+
+  Stopwatch stopwatch;
+  size_t frames = floor((trajectory.end_time() - trajectory.start_time()) * fps) + 1;
+  for (size_t i = 0; i < frames; ++i) {
+    trajectory.StatesAt(trajectory.start_time() + i / fps, states.data());
+    for (size_t j = 0; j < states.size(); ++j)
+      states[j].ToBody(scene.bodies[j]);
+    scene.Render();
+    readback.Capture(i, consume);
+    window.SwapBuffers();
+  }
+  readback.Poll(consume, true);
+  writer.Finish();
+  double t = stopwatch.TimeSinceRestart();
+  cerr << "rendered " << frames << " frames in " << t << " s (" << frames / t << " fps); "
+       << "readback stalls: " << readback.stalls() << ", encoder stalls: " << writer.stalls() << endl;
+  return 0;
+#else
+  throw NotImplementedException("headless rendering needs EGL");
+#endif
+}
+
+int main(int argc, char** argv) {
   try {
+    string record_path;
+    string replay_path;
+    string snapshot_path = "cube.snap"; // written when C is pressed
+    string resume_path;
+    string play_path;
+    string trajectory_path;
+    string frames_pattern;
+    double fps = 30;
+    ivec2 frame_size(512, 512);
+    bool gl_debug = false;
+    bool vsync = true;
+    double fps_cap = 0;
+    bool late_input = false;
+    string shader_cache_dir = DefaultShaderCacheDir();
+    Stopwatch startup_stopwatch;
+    for (int i = 1; i < argc; ++i) {
+      if (i + 1 < argc && !strcmp(argv[i], "--record"))
+        record_path = argv[++i];
+      else if (i + 1 < argc && !strcmp(argv[i], "--replay"))
+        replay_path = argv[++i];
+      else if (i + 1 < argc && !strcmp(argv[i], "--snapshot"))
+        snapshot_path = argv[++i];
+      else if (i + 1 < argc && !strcmp(argv[i], "--resume"))
+        resume_path = argv[++i];
+      else if (i + 1 < argc && !strcmp(argv[i], "--play"))
+        play_path = argv[++i];
+      else if (i + 1 < argc && !strcmp(argv[i], "--trajectory"))
+        trajectory_path = argv[++i];
+      else if (i + 1 < argc && !strcmp(argv[i], "--render-frames"))
+        frames_pattern = argv[++i];
+      else if (i + 1 < argc && !strcmp(argv[i], "--fps"))
+        fps = atof(argv[++i]);
+      else if (i + 1 < argc && !strcmp(argv[i], "--size") && sscanf(argv[i + 1], "%dx%d", &frame_size.x, &frame_size.y) == 2)
+        ++i;
+      else if (!strcmp(argv[i], "--gl-debug"))
+        gl_debug = true;
+      else if (i + 1 < argc && !strcmp(argv[i], "--vsync") && (!strcmp(argv[i + 1], "on") || !strcmp(argv[i + 1], "off")))
+        vsync = !strcmp(argv[++i], "on");
+      else if (i + 1 < argc && !strcmp(argv[i], "--fps-cap"))
+        fps_cap = atof(argv[++i]);
+      else if (!strcmp(argv[i], "--late-input"))
+        late_input = true;
+      else if (i + 1 < argc && !strcmp(argv[i], "--shader-cache"))
+        shader_cache_dir = argv[++i];
+      else
+        throw CommandLineArgumentsException(
+          string("unexpected argument ") + argv[i] + "; usage: cube [--record file | --replay file | --play file] "
+          "[--snapshot file] [--resume file] [--trajectory file] "
+          "[--render-frames pattern.ppm [--fps n] [--size WxH]] [--gl-debug] [--shader-cache dir|\"\"] "
+          "[--vsync on|off] [--fps-cap n] [--late-input]");
+    }
+
+    if (!replay_path.empty())
+      return Replay(replay_path, trajectory_path);
+    if (!frames_pattern.empty()) {
+      if (play_path.empty() || fps <= 0 || frame_size.x <= 0 || frame_size.y <= 0)
+        throw CommandLineArgumentsException("--render-frames needs --play, positive --fps and --size");
+      if (!IsFramePattern(frames_pattern))
+        throw CommandLineArgumentsException(
+          "--render-frames pattern needs exactly one integer conversion (e.g. frame%05d.ppm) and no other % but %%");
+      return RenderFrames(play_path, frames_pattern, fps, frame_size, gl_debug, shader_cache_dir);
+    }
+
     glfwSetErrorCallback(&LogGLFWError);
     glfw::Initializer glfw_init;
-    glfw::Window win_(ivec2(0, 0), ivec2(512, 512), "hello world", false);
+    glfw::Window win_(ivec2(0, 0), ivec2(512, 512), "hello world", false, gl_debug);
     ::window = &win_;
     window->MakeCurrent();
+    window->SwapInterval(vsync ? 1 : 0);
     GL::InitGl3wIfNeeded();
     GL::LogInfo();
+    GL::EnableDebugOutput(gl_debug);
+    unique_ptr<GL::ProgramBinaryCache> shader_cache;
+    if (!shader_cache_dir.empty())
+      shader_cache.reset(new GL::ProgramBinaryCache(shader_cache_dir));
 
     window->SetKeyCallback(&KeyCallback);
     window->SetScrollCallback(&ScrollCallback);
@@ -86,60 +377,159 @@ int main() {
     window->SetCursorPosCallback(&CursorPosCallback);
 
     Scene scene;
+    scene.program_cache = shader_cache.get();
+    Body* box = BuildScene(scene);
+    if (!resume_path.empty())
+      SceneSnapshot(resume_path).Restore(scene);
 
-    //Body* table = scene.AddBody(MakeBox(dvec3(3, .1, 3)));
-    //table->pos.y = -.05;
-    //scene.AddConstraint(-1, table->idx, dvec3(0, 0, 0), dquat(1, 0, 0, 0), Constraint::DOF::POS | Constraint::DOF::ROT);
-
-    Body* box = scene.AddBody(MakeBox(dvec3(.06,.06,.06)).MultiplyMass(1000));
+    int box_idx = box->idx;
 
-    auto reset = [&] {
-                   box->pos = dvec3(.03, .03, 0);
-                   box->rot = dquat(1, 0, 0, 0);
-                   box->momentum = dvec3(0, 0, 0);
-                   box->ang = dvec3(0, 0, 0);
-                 };
-
-    reset();
-
-    scene.AddConstraint(-1, box->idx, dvec3(-.03, -.03, -.03), dquat(1, 0, 0, 0), Constraint::DOF::POS | Constraint::DOF::RX | Constraint::DOF::RY);
+    // Playback of a trajectory file instead of simulation.
+    // Space pauses, left/right arrows play backwards/forwards and speed up, Home rewinds.
+    unique_ptr<TrajectoryReader> playback;
+    vector<BodyState> play_states;
+    double play_time = 0;
+    if (!play_path.empty()) {
+      playback.reset(new TrajectoryReader(play_path));
+      if (playback->bodies() != scene.bodies.size())
+        throw IOException("trajectory " + play_path + " has a different number of bodies than the scene");
+      play_states.resize(playback->bodies());
+      play_time = playback->start_time();
+    }
 
-    scene.gravity = dvec3(0, -9.8, 0);
+    // Simulation runs on its own thread with a copy of the scene; `scene` is only rendered.
+    // Declared last so that the thread is stopped before the recorder and writer are destroyed.
+    unique_ptr<InputRecorder> recorder;
+    unique_ptr<TrajectoryWriter> trajectory;
+    unique_ptr<PhysicsThread> physics;
+    if (!playback) {
+      physics.reset(new PhysicsThread(scene));
+      if (!record_path.empty()) {
+        recorder.reset(new InputRecorder(record_path));
+        recorder->RecordState(physics->scene());
+        physics->before_step = [&](Scene& s, double dt) {
+                                 recorder->RecordStep(s, dt);
+                               };
+      }
+      if (!trajectory_path.empty()) {
+        trajectory.reset(new TrajectoryWriter(trajectory_path, scene.bodies.size()));
+        physics->scene().trajectory_sink = trajectory.get();
+      }
+      physics->Start();
+    }
 
-    box->forces.emplace_back();
-    auto& force = box->forces.back();
+    auto reset = [&](Scene& s) {
+                   Body& b = s.bodies[box_idx];
+                   b.pos = dvec3(.03, .03, 0);
+                   b.rot = dquat(1, 0, 0, 0);
+                   b.momentum = dvec3(0, 0, 0);
+                   b.ang = dvec3(0, 0, 0);
+                   if (recorder)
+                     recorder->RecordState(s);
+                 };
+    auto log_stats = [](Scene& s) {
+                       cerr << "energy: " << s.GetEnergy()
+                            << "; leaked:  x: " << s.leaked_translation << ", r: " << s.leaked_rotation
+                            << ", v: " << s.leaked_velocity << ", w: " << s.leaked_angular_velocity
+                            << "  res ok: " << s.force_resolution_success << " fail: " << s.force_resolution_failed << endl;
+                     };
 
     scene.camera.pos = fvec3(-.1, .12, .15);
     scene.camera.LookAt(box->pos);
 
+    // With --late-input the loop sleeps until just before the frame is due, then polls input
+    // and draws the latest physics state extrapolated to the predicted present.
+    FramePacer pacer(fps_cap, late_input);
+    // Don't extrapolate further than this, e.g. while physics is stalled.
+    const double max_extrapolation = .05;
+    double input_latency = 0;
+    StatsHud hud;
     Stopwatch frame_stopwatch;
     while (!window->ShouldClose()) {
+      pacer.WaitForFrameStart();
+      glfwPollEvents();
+      chrono::steady_clock::time_point input_time = chrono::steady_clock::now();
       double dt = frame_stopwatch.Restart();
       ++frame_idx;
 
       UpdateFPS();
 
-      if (window->IsKeyPressed(GLFW_KEY_R))
-        reset();
+      if (snapshot_requested) {
+        snapshot_requested = false;
+        auto save = [snapshot_path](Scene& s) {
+                      SceneSnapshot(s).Save(snapshot_path);
+                      cerr << "saved snapshot to " << snapshot_path << endl;
+                    };
+        if (physics)
+          physics->Post(save);
+        else
+          save(scene);
+      }
+
+      if (playback) {
+        if (play_rewind) {
+          play_rewind = false;
+          play_time = playback->start_time();
+        }
+        if (!play_paused)
+          play_time += dt * play_speed;
+        play_time = max(playback->start_time(), min(playback->end_time(), play_time));
+        playback->StatesAt(play_time, play_states.data());
+        for (size_t i = 0; i < play_states.size(); ++i)
+          play_states[i].ToBody(scene.bodies[i]);
+        scene.time = play_time;
+      } else {
+        if (window->IsKeyPressed(GLFW_KEY_R))
+          physics->Post(reset);
 
-      dvec3 in = ThreeDofInput(*window, "IKJLUM");
-      force.first = box->pos;
-      force.second = in * 2.2;
+        dvec3 in = ThreeDofInput(*window, "IKJLUM");
+        physics->SetForce(box_idx, in * 2.2, input_time);
 
-      scene.PhysicsStep(dt);
+        if (frame_idx % 120 == 0)
+          physics->Post(log_stats);
 
-      if (frame_idx % 120 == 0) {
-        double e = scene.GetEnergy();
-        cerr << "energy: " << e
-             << "; leaked:  x: " << scene.leaked_translation << ", r: " << scene.leaked_rotation
-             << ", v: " << scene.leaked_velocity << ", w: " << scene.leaked_angular_velocity
-             << "  res ok: " << scene.force_resolution_success << " fail: " << scene.force_resolution_failed << endl;
+        physics->Update();
+        double extrapolate = 0;
+        if (late_input)
+          extrapolate = min(max_extrapolation,
+                            chrono::duration<double>(pacer.next_present() - physics->frame().published).count());
+        physics->frame().Apply(scene, extrapolate);
       }
-      
+
       scene.Render();
+      hud.Update(dt, physics.get(), input_latency);
+      hud.Render(window->GetFramebufferSize());
       
+      pacer.FrameRendered();
       window->SwapBuffers();
-      glfwPollEvents();
+      pacer.FramePresented();
+      if (frame_idx == 1) {
+        glFinish();
+        cerr << "first frame after " << startup_stopwatch.TimeSinceRestart() << " s; shader cache "
+             << (!shader_cache ? "off" : shader_cache->hits() ? "hit" : "miss") << endl;
+      }
+      if (physics) {
+        chrono::steady_clock::time_point now = chrono::steady_clock::now();
+        const PhysicsThread::Frame& f = physics->frame();
+        physics_latency_sum += chrono::duration<double>(now - f.published).count();
+        if (f.input_sampled != chrono::steady_clock::time_point()) {
+          input_latency = chrono::duration<double>(now - f.input_sampled).count();
+          input_latency_sum += input_latency;
+          ++input_latency_frames;
+        }
+      }
+    }
+
+    if (physics) {
+      physics->Stop();
+      if (physics->overruns())
+        cerr << "physics fell behind real time " << physics->overruns() << " times" << endl;
+    }
+    if (trajectory)
+      trajectory->Finish();
+    if (recorder) {
+      recorder->Finish(physics->scene());
+      cerr << "recorded " << recorder->steps() << " steps to " << record_path << endl;
     }
   } catch (std::exception& e) {
     std::cerr << "exception: " << e.what() << std::endl;
@@ -2,8 +2,9 @@
 #include "util/exceptions.h"
 
 BodyEdit& BodyEdit::AddColor(fvec3 color) {
-  for (Vertex& v: vertices)
+  ForEachVertex([&](Vertex& v) {
     v.color += color;
+  });
   return *this;
 }
 
@@ -20,6 +21,14 @@ static dmat3 PointInertia(dvec3 p) {
 }
 
 BodyEdit& BodyEdit::Merge(const BodyEdit& b) {
+  size_t levels = std::max(coarser.size(), b.coarser.size());
+  std::vector<std::vector<Vertex>> merged(levels);
+  for (size_t i = 0; i < levels; ++i) {
+    merged[i] = Level(i + 1);
+    const std::vector<Vertex>& other = b.Level(i + 1);
+    merged[i].insert(merged[i].end(), other.begin(), other.end());
+  }
+  coarser.swap(merged);
   vertices.insert(vertices.end(), b.vertices.begin(), b.vertices.end());
   dvec3 ncom = (com * mass + b.com * b.mass) / (mass + b.mass);
   // Inertia around origin is inertia around c.o.m. + inertia of c.o.m. around origin.
@@ -31,27 +40,28 @@ BodyEdit& BodyEdit::Merge(const BodyEdit& b) {
 }
 
 BodyEdit& BodyEdit::Translate(dvec3 d) {
-  for (Vertex& v: vertices)
+  ForEachVertex([&](Vertex& v) {
     v.pos += fvec3(d);
+  });
   com += d;
   return *this;
 }
 
 BodyEdit& BodyEdit::Rotate(dquat q) {
-  for (Vertex& v: vertices) {
-    v.pos = q.Transform(v.pos);
-    v.normal = q.Transform(v.normal);
-  }
-  com = q.Transform(com);
-  dmat3 m = q.ToMatrix();
-  inertia = m*inertia*m.Transposed();
+  const drot3 r(q);
+  ForEachVertex([&](Vertex& v) {
+    v.pos = r.Rotate(v.pos);
+    v.normal = r.Rotate(v.normal);
+  });
+  com = r.Rotate(com);
+  inertia = r.m*inertia*r.m.Transposed();
   return *this;
 }
 
 BodyEdit& BodyEdit::Scale(double factor) {
-  for (Vertex& v: vertices) {
+  ForEachVertex([&](Vertex& v) {
     v.pos *= factor;
-  }
+  });
   com *= factor;
   mass *= pow(factor, 3);
   inertia *= pow(factor, 3);
@@ -85,15 +95,10 @@ BodyEdit MakeBox(dvec3 s) {
   return b;
 }
 
-BodyEdit MakeTube(double in_r, double out_r, double h) {
-  BodyEdit b;
-  b.mass = M_PI*(out_r*out_r - in_r*in_r)*h;
-  b.com = fvec3(0, 0, 0);
-  double t = in_r*in_r + out_r*out_r;
-  b.inertia = b.mass/12 * dmat3::Diag(3*t + h*h, 6*t, 3*t + h*h);
-
+static std::vector<BodyEdit::Vertex> TubeVertices(double in_r, double out_r, double h, int sides) {
   using Vertex = BodyEdit::Vertex;
-  const int sides = 100;
+  std::vector<Vertex> vertices;
+  vertices.reserve(sides * (in_r > 0 ? 24 : 12));
   for (int i = 0; i < sides; ++i) {
     float a1 = M_PI * 2 / sides * (i-.5);
     float a2 = M_PI * 2 / sides * (i+.5);
@@ -103,54 +108,68 @@ BodyEdit MakeTube(double in_r, double out_r, double h) {
     fvec3 u(0,  h/2, 0);
     fvec3 o1 = n1*out_r;
     fvec3 o2 = n2*out_r;
-    size_t sz0 = b.vertices.size();
+    size_t sz0 = vertices.size();
     // Outer face.
-    b.vertices.push_back(Vertex(o1 - u, n1));
-    b.vertices.push_back(Vertex(o2 - u, n2));
-    b.vertices.push_back(Vertex(o2 + u, n2));
-    b.vertices.push_back(Vertex(o2 + u, n2));
-    b.vertices.push_back(Vertex(o1 + u, n1));
-    b.vertices.push_back(Vertex(o1 - u, n1));
+    vertices.push_back(Vertex(o1 - u, n1));
+    vertices.push_back(Vertex(o2 - u, n2));
+    vertices.push_back(Vertex(o2 + u, n2));
+    vertices.push_back(Vertex(o2 + u, n2));
+    vertices.push_back(Vertex(o1 + u, n1));
+    vertices.push_back(Vertex(o1 - u, n1));
     if (in_r > 0) { // tube
       fvec3 i1 = n1*in_r;
       fvec3 i2 = n2*in_r;
       // Inner face.
-      b.vertices.push_back(Vertex(i1 + u, n1));
-      b.vertices.push_back(Vertex(i2 + u, n2));
-      b.vertices.push_back(Vertex(i2 - u, n2));
-      b.vertices.push_back(Vertex(i2 - u, n2));
-      b.vertices.push_back(Vertex(i1 - u, n1));
-      b.vertices.push_back(Vertex(i1 + u, n1));
+      vertices.push_back(Vertex(i1 + u, n1));
+      vertices.push_back(Vertex(i2 + u, n2));
+      vertices.push_back(Vertex(i2 - u, n2));
+      vertices.push_back(Vertex(i2 - u, n2));
+      vertices.push_back(Vertex(i1 - u, n1));
+      vertices.push_back(Vertex(i1 + u, n1));
       // Top face.
-      b.vertices.push_back(Vertex(o1 + u, nu));
-      b.vertices.push_back(Vertex(o2 + u, nu));
-      b.vertices.push_back(Vertex(i2 + u, nu));
-      b.vertices.push_back(Vertex(i2 + u, nu));
-      b.vertices.push_back(Vertex(i1 + u, nu));
-      b.vertices.push_back(Vertex(o1 + u, nu));
+      vertices.push_back(Vertex(o1 + u, nu));
+      vertices.push_back(Vertex(o2 + u, nu));
+      vertices.push_back(Vertex(i2 + u, nu));
+      vertices.push_back(Vertex(i2 + u, nu));
+      vertices.push_back(Vertex(i1 + u, nu));
+      vertices.push_back(Vertex(o1 + u, nu));
       // Bottom face.
-      b.vertices.push_back(Vertex(o2 - u, -nu));
-      b.vertices.push_back(Vertex(o1 - u, -nu));
-      b.vertices.push_back(Vertex(i1 - u, -nu));
-      b.vertices.push_back(Vertex(i1 - u, -nu));
-      b.vertices.push_back(Vertex(i2 - u, -nu));
-      b.vertices.push_back(Vertex(o2 - u, -nu));      
+      vertices.push_back(Vertex(o2 - u, -nu));
+      vertices.push_back(Vertex(o1 - u, -nu));
+      vertices.push_back(Vertex(i1 - u, -nu));
+      vertices.push_back(Vertex(i1 - u, -nu));
+      vertices.push_back(Vertex(i2 - u, -nu));
+      vertices.push_back(Vertex(o2 - u, -nu));      
     } else { // cylinder
       // Top face.
-      b.vertices.push_back(Vertex(o1 + u, nu));
-      b.vertices.push_back(Vertex(o2 + u, nu));
-      b.vertices.push_back(Vertex(u, nu));
+      vertices.push_back(Vertex(o1 + u, nu));
+      vertices.push_back(Vertex(o2 + u, nu));
+      vertices.push_back(Vertex(u, nu));
       // Bottom face.
-      b.vertices.push_back(Vertex(o2 - u, -nu));
-      b.vertices.push_back(Vertex(o1 - u, -nu));
-      b.vertices.push_back(Vertex(-u, -nu));
+      vertices.push_back(Vertex(o2 - u, -nu));
+      vertices.push_back(Vertex(o1 - u, -nu));
+      vertices.push_back(Vertex(-u, -nu));
     }
     if (!i) {
       // A red stripe to make rotation visible.
-      for (size_t j = sz0; j < b.vertices.size(); ++j)
-        b.vertices[j].color = fvec3(1, 0, 0);
+      for (size_t j = sz0; j < vertices.size(); ++j)
+        vertices[j].color = fvec3(1, 0, 0);
     }
   }
+  return vertices;
+}
+
+BodyEdit MakeTube(double in_r, double out_r, double h) {
+  BodyEdit b;
+  b.mass = M_PI*(out_r*out_r - in_r*in_r)*h;
+  b.com = fvec3(0, 0, 0);
+  double t = in_r*in_r + out_r*out_r;
+  b.inertia = b.mass/12 * dmat3::Diag(3*t + h*h, 6*t, 3*t + h*h);
+
+  // Levels of detail: 100, 50, 25 and 12 sides.
+  b.vertices = TubeVertices(in_r, out_r, h, 100);
+  for (int sides: {50, 25, 12})
+    b.coarser.push_back(TubeVertices(in_r, out_r, h, sides));
   return b;
 }
 
@@ -0,0 +1,75 @@
+#include "sim/hud.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+using namespace std;
+
+const size_t Hud::kSamples;
+
+static const float kGraphWidth = 2 * Hud::kSamples; // 2 pixels per sample
+static const float kGraphHeight = 24;
+static const float kMargin = 4;
+
+int Hud::AddGraph(const string& name, const string& unit, float scale) {
+  graphs_.emplace_back();
+  Graph& g = graphs_.back();
+  g.name = name;
+  g.unit = unit;
+  g.scale = scale;
+  g.samples.resize(kSamples);
+  return graphs_.size() - 1;
+}
+
+void Hud::Push(int graph, float value) {
+  Graph& g = graphs_[graph];
+  g.samples[g.next] = value;
+  g.next = (g.next + 1) % kSamples;
+  g.count = min(g.count + 1, kSamples);
+}
+
+void Hud::Render(ivec2 viewport_size) {
+  if (!visible)
+    return;
+  auto start = chrono::steady_clock::now();
+  if (!overlay_)
+    overlay_.reset(new GL::Overlay());
+  GL::Overlay& o = *overlay_;
+  o.Begin(viewport_size);
+
+  const fvec4 background(0, 0, 0, .5f);
+  const fvec4 bar(.3f, 1, .3f, .8f);
+  const fvec4 text(1, 1, 1, 1);
+  float row = kGraphHeight + GL::Overlay::kCharHeight + 2 * kMargin;
+  o.Rect(0, 0, kGraphWidth + 2 * kMargin, row * graphs_.size() + GL::Overlay::kCharHeight + kMargin, background);
+
+  char buf[128];
+  for (size_t i = 0; i < graphs_.size(); ++i) {
+    Graph& g = graphs_[i];
+    float x = kMargin, y = kMargin + row * i;
+    float top = 0;
+    for (size_t j = 0; j < g.count; ++j)
+      top = max(top, g.samples[j]);
+    g.scale = max(g.scale, top);
+
+    if (g.count) {
+      float last = g.samples[(g.next + kSamples - 1) % kSamples];
+      snprintf(buf, sizeof(buf), "%s %.3g %s (max %.3g)", g.name.c_str(), last, g.unit.c_str(), top);
+    } else {
+      snprintf(buf, sizeof(buf), "%s -", g.name.c_str());
+    }
+    o.Text(x, y, buf, text);
+    y += GL::Overlay::kCharHeight + 2;
+
+    // Oldest sample on the left.
+    for (size_t j = 0; j < g.count; ++j) {
+      float v = g.samples[(g.next + kSamples - g.count + j) % kSamples];
+      float h = min(max(v / g.scale, 0.f), 1.f) * kGraphHeight;
+      o.Rect(x + 2 * (kSamples - g.count + j), y + kGraphHeight - h, 2, h, bar);
+    }
+  }
+
+  snprintf(buf, sizeof(buf), "hud %.3f ms", render_seconds_ * 1e3);
+  o.Text(kMargin, row * graphs_.size(), buf, text);
+  o.End();
+  render_seconds_ = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include "gl-util/overlay.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+// Rolling graphs of per-frame statistics (frame time, physics time etc.) drawn in a column
+// in the top left corner of the window, each with its name and latest value.
+//   Hud hud;
+//   int frame_ms = hud.AddGraph("frame", "ms", 33);
+//   ...every frame, after rendering the scene:
+//   hud.Push(frame_ms, dt * 1e3);
+//   hud.Render(viewport_size);
+// Drawing everything is one batched draw call; the cost of the previous Render() is shown too.
+class Hud {
+ public:
+  // Samples kept per graph.
+  static const size_t kSamples = 120;
+
+  // `scale` is the initial value at the top of the graph; it grows to fit the values shown.
+  int AddGraph(const std::string& name, const std::string& unit, float scale);
+  void Push(int graph, float value);
+
+  // Needs a current OpenGL context; the first call creates the GL objects.
+  void Render(ivec2 viewport_size);
+
+  // CPU time of the last Render().
+  double render_seconds() const {
+    return render_seconds_;
+  }
+
+  bool visible = true;
+
+ private:
+  struct Graph {
+    std::string name;
+    std::string unit;
+    float scale;
+    std::vector<float> samples; // ring buffer
+    size_t next = 0;
+    size_t count = 0;
+  };
+
+  std::vector<Graph> graphs_;
+  std::unique_ptr<GL::Overlay> overlay_;
+  double render_seconds_ = 0;
+};
@@ -0,0 +1,239 @@
+#include "sim/mesh-build.h"
+#include <algorithm>
+#include <cstddef>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <unordered_map>
+using namespace std;
+
+namespace {
+
+struct VertexHash {
+  size_t operator()(const BodyEdit::Vertex& v) const {
+    // FNV-1a.
+    const unsigned char* p = (const unsigned char*)&v;
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < sizeof(v); ++i) {
+      h ^= p[i];
+      h *= 1099511628211ull;
+    }
+    return h;
+  }
+};
+
+struct VertexEqual {
+  bool operator()(const BodyEdit::Vertex& a, const BodyEdit::Vertex& b) const {
+    return !memcmp(&a, &b, sizeof(a));
+  }
+};
+
+// Parameters from Forsyth's article.
+const int kCacheSize = 32;
+const float kCacheDecayPower = 1.5f;
+const float kLastTriangleScore = .75f;
+const float kValenceBoostScale = 2.f;
+const float kValenceBoostPower = .5f;
+
+float VertexScore(int cache_pos, int remaining_triangles) {
+  if (!remaining_triangles)
+    return -1;
+  float score = 0;
+  if (cache_pos >= 0) {
+    if (cache_pos < 3)
+      score = kLastTriangleScore;
+    else
+      score = pow(1 - (cache_pos - 3) * (1.f / (kCacheSize - 3)), kCacheDecayPower);
+  }
+  return score + kValenceBoostScale * pow((float)remaining_triangles, -kValenceBoostPower);
+}
+
+}
+
+static vector<uint32_t> OptimizeVertexCache(const vector<uint32_t>& indices, size_t nvertices) {
+  size_t ntriangles = indices.size() / 3;
+
+  // Triangles of each vertex: not yet emitted ones are the first `remaining[v]`
+  // of triangles[offsets[v]..offsets[v+1]).
+  vector<int> remaining(nvertices);
+  for (uint32_t v: indices)
+    ++remaining[v];
+  vector<size_t> offsets(nvertices + 1);
+  for (size_t v = 0; v < nvertices; ++v)
+    offsets[v + 1] = offsets[v] + remaining[v];
+  vector<uint32_t> triangles(indices.size());
+  {
+    vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); ++i)
+      triangles[fill[indices[i]]++] = i / 3;
+  }
+
+  vector<int> cache_pos(nvertices, -1);
+  vector<float> vertex_score(nvertices);
+  for (size_t v = 0; v < nvertices; ++v)
+    vertex_score[v] = VertexScore(-1, remaining[v]);
+  vector<float> triangle_score(ntriangles);
+  vector<bool> emitted(ntriangles);
+  for (size_t t = 0; t < ntriangles; ++t)
+    triangle_score[t] = vertex_score[indices[t*3]] + vertex_score[indices[t*3+1]] + vertex_score[indices[t*3+2]];
+
+  vector<uint32_t> out;
+  out.reserve(indices.size());
+  vector<uint32_t> cache, new_cache;
+  size_t scan_from = 0; // all triangles before it are emitted
+  long best = -1;
+  while (out.size() < indices.size()) {
+    if (best < 0) {
+      // Nothing useful in the cache; start over from the best remaining triangle.
+      while (emitted[scan_from])
+        ++scan_from;
+      best = scan_from;
+      for (size_t t = scan_from; t < ntriangles; ++t)
+        if (!emitted[t] && triangle_score[t] > triangle_score[best])
+          best = t;
+    }
+
+    emitted[best] = true;
+    new_cache.clear();
+    for (int k = 0; k < 3; ++k) {
+      uint32_t v = indices[best*3 + k];
+      out.push_back(v);
+      new_cache.push_back(v);
+      uint32_t* tris = &triangles[offsets[v]];
+      int n = remaining[v]--;
+      *find(tris, tris + n, (uint32_t)best) = tris[n - 1];
+    }
+    for (uint32_t v: cache)
+      if (find(new_cache.begin(), new_cache.end(), v) == new_cache.end())
+        new_cache.push_back(v);
+    for (size_t i = 0; i < new_cache.size(); ++i) {
+      uint32_t v = new_cache[i];
+      cache_pos[v] = i < (size_t)kCacheSize ? i : -1;
+      vertex_score[v] = VertexScore(cache_pos[v], remaining[v]);
+    }
+    if (new_cache.size() > (size_t)kCacheSize)
+      new_cache.resize(kCacheSize);
+    swap(cache, new_cache);
+
+    best = -1;
+    float best_score = -1;
+    for (uint32_t v: cache) {
+      for (int i = 0; i < remaining[v]; ++i) {
+        uint32_t t = triangles[offsets[v] + i];
+        float s = vertex_score[indices[t*3]] + vertex_score[indices[t*3+1]] + vertex_score[indices[t*3+2]];
+        triangle_score[t] = s;
+        if (s > best_score) {
+          best_score = s;
+          best = t;
+        }
+      }
+    }
+  }
+  return out;
+}
+
+IndexedMesh BuildIndexedMesh(const vector<BodyEdit::Vertex>& soup) {
+  // Weld.
+  vector<BodyEdit::Vertex> unique;
+  vector<uint32_t> indices;
+  indices.reserve(soup.size());
+  unordered_map<BodyEdit::Vertex, uint32_t, VertexHash, VertexEqual> ids;
+  for (const BodyEdit::Vertex& v: soup) {
+    auto it = ids.emplace(v, unique.size()).first;
+    if (it->second == unique.size())
+      unique.push_back(v);
+    indices.push_back(it->second);
+  }
+
+  indices = OptimizeVertexCache(indices, unique.size());
+
+  // Renumber vertices in order of first use.
+  IndexedMesh res;
+  res.vertices.reserve(unique.size());
+  vector<uint32_t> remap(unique.size(), (uint32_t)-1);
+  for (uint32_t& i: indices) {
+    if (remap[i] == (uint32_t)-1) {
+      remap[i] = res.vertices.size();
+      res.vertices.push_back(unique[i]);
+    }
+    i = remap[i];
+  }
+  res.indices = std::move(indices);
+  return res;
+}
+
+const GL::VertexArray::Format& PackedVertex::Format() {
+  static const GL::VertexArray::Format format = GL::VertexArray::Format(sizeof(PackedVertex))
+    .Add(0, 3, GL_UNSIGNED_SHORT, offsetof(PackedVertex, pos), true)
+    .Add(1, 4, GL_INT_2_10_10_10_REV, offsetof(PackedVertex, normal), true)
+    .Add(2, 4, GL_UNSIGNED_BYTE, offsetof(PackedVertex, color), true);
+  return format;
+}
+
+static uint32_t PackNormal(fvec3 n) {
+  auto pack = [](float c) {
+    return (uint32_t)lround(max(-1.f, min(1.f, c)) * 511) & 0x3ff;
+  };
+  return pack(n.x) | pack(n.y) << 10 | pack(n.z) << 20;
+}
+
+static uint8_t PackColor(float c) {
+  return lround(max(0.f, min(1.f, c)) * 255);
+}
+
+PackedMesh PackVertices(const vector<BodyEdit::Vertex>& vertices) {
+  PackedMesh res;
+  if (vertices.empty())
+    return res;
+  fvec3 lo = vertices[0].pos;
+  fvec3 hi = vertices[0].pos;
+  for (const BodyEdit::Vertex& v: vertices) {
+    lo = lo.Min(v.pos);
+    hi = hi.Max(v.pos);
+  }
+  res.pos_offset = lo;
+  res.pos_scale = hi - lo;
+  fvec3& scale = res.pos_scale;
+  // Flat meshes.
+  if (scale.x == 0)
+    scale.x = 1;
+  if (scale.y == 0)
+    scale.y = 1;
+  if (scale.z == 0)
+    scale.z = 1;
+
+  auto quantize = [](float p, float offset, float scale) {
+    return (uint16_t)lround((p - offset) / scale * 65535);
+  };
+  res.vertices.resize(vertices.size());
+  for (size_t i = 0; i < vertices.size(); ++i) {
+    const BodyEdit::Vertex& v = vertices[i];
+    PackedVertex& p = res.vertices[i];
+    p.pos[0] = quantize(v.pos.x, lo.x, scale.x);
+    p.pos[1] = quantize(v.pos.y, lo.y, scale.y);
+    p.pos[2] = quantize(v.pos.z, lo.z, scale.z);
+    p.pos[3] = 0;
+    p.normal = PackNormal(v.normal);
+    p.color[0] = PackColor(v.color.x);
+    p.color[1] = PackColor(v.color.y);
+    p.color[2] = PackColor(v.color.z);
+    p.color[3] = 255;
+  }
+  return res;
+}
+
+double AverageCacheMissRatio(const vector<uint32_t>& indices, size_t cache_size) {
+  if (indices.empty())
+    return 0;
+  deque<uint32_t> cache;
+  size_t misses = 0;
+  for (uint32_t v: indices) {
+    if (find(cache.begin(), cache.end(), v) != cache.end())
+      continue;
+    ++misses;
+    cache.push_back(v);
+    if (cache.size() > cache_size)
+      cache.pop_front();
+  }
+  return (double)misses / (indices.size() / 3);
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include "sim/scene.h"
+#include <vector>
+
+// Indexed form of a triangle soup, for glDrawElements.
+struct IndexedMesh {
+  std::vector<BodyEdit::Vertex> vertices;
+  std::vector<uint32_t> indices; // 3 per triangle
+};
+
+// Welds bitwise identical vertices of `soup` (3 per triangle), orders triangles for
+// post-transform vertex cache hits (Tom Forsyth's "Linear-Speed Vertex Cache Optimisation")
+// and then vertices in order of first use, for locality of vertex fetches.
+IndexedMesh BuildIndexedMesh(const std::vector<BodyEdit::Vertex>& soup);
+
+// Compact GPU vertex, 16 bytes instead of 36 for BodyEdit::Vertex.
+struct PackedVertex {
+  uint16_t pos[4]; // xyz normalized to [0, 65535] within the mesh bounds, see PackedMesh; [3] is padding
+  uint32_t normal; // GL_INT_2_10_10_10_REV, signed normalized xyz
+  uint8_t color[4]; // normalized rgb; [3] is padding
+
+  // Attributes 0 (pos, vec3), 1 (normal, vec4) and 2 (color, vec4).
+  static const GL::VertexArray::Format& Format();
+};
+
+struct PackedMesh {
+  std::vector<PackedVertex> vertices;
+  // Position in mesh space is pos_offset + pos_scale * (PackedVertex::pos / 65535).
+  fvec3 pos_offset;
+  fvec3 pos_scale;
+};
+
+// Quantizes positions to 16 bits over the bounding box (error up to 1/131070 of its size),
+// normals to 10 bits and colors to 8 bits. Colors are clamped to [0, 1].
+PackedMesh PackVertices(const std::vector<BodyEdit::Vertex>& vertices);
+
+// Average number of vertex shader invocations per triangle with a FIFO post-transform cache
+// of `cache_size` entries: 3 for no reuse, ~0.5-0.7 for a good ordering of a regular mesh.
+double AverageCacheMissRatio(const std::vector<uint32_t>& indices, size_t cache_size = 16);
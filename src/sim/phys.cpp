@@ -1,61 +1,50 @@
 #include "sim/scene.h"
+#include "util/dual.h"
 #include "util/linear.h"
+#include "util/quat-arrays.h"
 #include "util/print.h"
+#include <chrono>
 #include <valarray>
 #include <cassert>
 #include <iostream>
 using namespace std;
 
+// The physics below is templated on the scalar type T of the state: double for PhysicsStep(), and
+// dual numbers for StepJacobian().
+
 namespace {
 
 static const Body fixed_body = Body(-1);
 
-struct BodyState {
-  dvec3 pos;
-  dquat rot;
-  dvec3 momentum;
-  dvec3 ang;
-
-  BodyState() = default;
-
-  void FromBody(const Body& b) {
-    pos = b.pos; rot = b.rot; momentum = b.momentum; ang = b.ang;
-  }
-  void ToBody(Body& b) {
-    b.pos = pos; b.rot = rot; b.momentum = momentum; b.ang = ang;
-  }
-
-  static BodyState Zero() {
-    BodyState s;
-    memset(&s, 0, sizeof(s));
-    s.rot.a = 1;
-    return s;
-  }
-};
-
-static const BodyState fixed_body_state = BodyState::Zero();
+// Of PhysicsStep().
+static const int kSubsteps = 100;
 
+template<typename T>
 struct BodyForce {
-  dvec3 force = {0, 0, 0};
-  dvec3 torque = {0, 0, 0};
+  tvec3<T> force = {0, 0, 0};
+  tvec3<T> torque = {0, 0, 0};
 };
-ostream& operator<<(ostream& o, const BodyForce& f) __attribute__ ((unused));
-ostream& operator<<(ostream& o, const BodyForce& f) {
+template<typename T>
+ostream& operator<<(ostream& o, const BodyForce<T>& f) {
   return o << "(F:" << f.force << ",tau:" << f.torque << ")";
 }
 
+template<typename T>
 struct StateVector {
   StateVector(size_t n): bodies_(n) {}
 
   size_t size() const {
     return bodies_.size();
   }
-  BodyState& operator[](size_t i) {
+  TBodyState<T>& operator[](size_t i) {
     return bodies_[i];
   }
-  const BodyState& operator[](size_t i) const {
+  const TBodyState<T>& operator[](size_t i) const {
     return bodies_[i];
   }
+  const TBodyState<T>* data() const {
+    return bodies_.data();
+  }
 
   // *this = s + h * v;  s is allowed to point to *this
   StateVector& AddMul(const StateVector& s, double h, const StateVector& v) {
@@ -71,32 +60,163 @@ struct StateVector {
   }
 
  private:
-  vector<BodyState> bodies_;
+  vector<TBodyState<T>> bodies_;
+};
+
+// What the physics needs of a Body and of a Constraint, in T.
+template<typename T>
+struct BodyConstants {
+  T inv_mass = 0;
+  tmat3<T> inv_inertia = tmat3<T>::Zero();
+
+  BodyConstants() {}
+  explicit BodyConstants(const Body& b): inv_mass(b.inv_mass), inv_inertia(b.inv_inertia) {}
+};
+template<typename T>
+struct ConstraintConstants {
+  int body1, body2;
+  tvec3<T> pos1, pos2;
+  tquat<T> rot1;
+  trot3<T> rot; // rot1 as a matrix
+  Constraint::dof_t lock;
+
+  explicit ConstraintConstants(const Constraint& c)
+    : body1(c.body1), body2(c.body2), pos1(c.pos1), pos2(c.pos2), rot1(c.rot1), rot(rot1), lock(c.lock) {}
 };
 
+// Quantities derived from a body's state that force resolution and the derivative need several
+// times each, computed once per RK stage by Derive().
+template<typename T>
+struct DerivedState {
+  trot3<T> rot; // rot as a matrix
+  tvec3<T> ang_body; // angular momentum in body space
+  tvec3<T> av; // angular velocity in body space
+  tmat3<T> world_to_av; // inv_inertia * rot^-1: torque (or angular momentum) -> change of av
+  tvec3<T> precession; // inv_inertia * av x ang_body
+  tvec3<T> velocity; // momentum * inv_mass
+};
+
+// The rest of `d`, once rot and ang_body are set.
+template<typename T>
+void DeriveRest(const BodyConstants<T>& b, const TBodyState<T>& s, DerivedState<T>& d) {
+  d.av = b.inv_inertia * d.ang_body;
+  d.world_to_av = b.inv_inertia * d.rot.m.Transposed();
+  d.precession = b.inv_inertia * d.av.Cross(d.ang_body);
+  d.velocity = s.momentum * b.inv_mass;
+}
+
+template<typename T>
+DerivedState<T> Derive(const BodyConstants<T>& b, const TBodyState<T>& s) {
+  DerivedState<T> d;
+  d.rot = trot3<T>(s.rot);
+  d.ang_body = d.rot.Unrotate(s.ang);
+  DeriveRest(b, s, d);
+  return d;
+}
+
+// All bodies at once.
+template<typename T>
+void Derive(const vector<BodyConstants<T>>& bodies, const StateVector<T>& state, vector<DerivedState<T>>& derived) {
+  derived.resize(bodies.size());
+  for (size_t i = 0; i < bodies.size(); ++i)
+    derived[i] = Derive(bodies[i], state[i]);
+}
+
+// For doubles, rot and ang_body with the array kernels, the rest body by body.
+void Derive(const vector<BodyConstants<double>>& bodies, const StateVector<double>& state,
+            vector<DerivedState<double>>& derived) {
+  size_t n = bodies.size();
+  derived.resize(n);
+  if (!n)
+    return;
+  QuatsToMatrices(n, {&state[0].rot, sizeof(BodyState)}, {&derived[0].rot.m, sizeof(DerivedState<double>)});
+  UnrotateVectors(n, {&derived[0].rot.m, sizeof(DerivedState<double>)}, {&state[0].ang, sizeof(BodyState)},
+                  {&derived[0].ang_body, sizeof(DerivedState<double>)});
+  for (size_t i = 0; i < n; ++i)
+    DeriveRest(bodies[i], state[i], derived[i]);
+}
+
+// Renormalizes the rotations, as at the end of PhysicsStep().
+template<typename T>
+void NormalizeRotations(StateVector<T>& state) {
+  for (size_t i = 0; i < state.size(); ++i)
+    state[i].rot.NormalizeMe();
+}
+
+void NormalizeRotations(StateVector<double>& state) {
+  if (state.size())
+    NormalizeQuats(state.size(), {&state[0].rot, sizeof(BodyState)});
+}
+
+template<typename T>
 struct Context {
-  vector<BodyForce> external_forces;
+  // Everything that stays the same through a PhysicsStep() starting from `state`.
+  Context(const Scene& scene, const StateVector<T>& state);
+
+  const BodyConstants<T>& body(int idx) const {
+    return idx == -1 ? fixed_body : bodies[idx];
+  }
+  const TBodyState<T>& body_state(const StateVector<T>& state, int idx) const {
+    return idx == -1 ? fixed_body_state : state[idx];
+  }
+
+  vector<BodyConstants<T>> bodies;
+  vector<ConstraintConstants<T>> constraints;
+  // Body -1, the world.
+  BodyConstants<T> fixed_body;
+  TBodyState<T> fixed_body_state = TBodyState<T>::Zero();
+  DerivedState<T> fixed_body_derived;
+  vector<BodyForce<T>> external_forces;
+  // Derived from the state ResolveForces() was last called with.
+  vector<DerivedState<T>> derived;
   // External + constraint.
-  vector<BodyForce> effective_forces;
+  vector<BodyForce<T>> effective_forces;
   // Constraint idx -> idx of the first var. #vars is # locked DOFs.
   vector<int> var_idx;
   // Force and torque on each body represented as linear combination of variables.
   // [(v+1)*(b*2+f) + i] is the contribution of variable i to force/torque f on body b,
   // v is number of variables, b is body idx, f is 0 for linear force, 1 for torque,
   // i is variable index, v for free coefficient (with opposite sign).
-  vector<dvec3> force_from_vars;
+  vector<tvec3<T>> force_from_vars;
   // Linear equation system. Vars - forces/torques from constraints,
   // rows - constraints (second derivative), last column - "b" as in Ax=b.
-  DMatrix equations;
+  TMatrix<T> equations;
+
+  // Stats for the Scene, see Scene::PhysicsStep().
+  Scene::PhysicsProfile* profile = nullptr;
+  double solver_seconds = 0;
+  size_t force_resolution_success = 0;
+  size_t force_resolution_failed = 0;
 };
 
+template<typename T>
+Context<T>::Context(const Scene& scene, const StateVector<T>& state) {
+  var_idx.resize(scene.constraints.size() + 1);
+  for (size_t i = 0; i < scene.constraints.size(); ++i) {
+    const Constraint& c = scene.constraints[i];
+    size_t n = __builtin_popcount(c.lock);
+    var_idx[i + 1] = var_idx[i] + n;
+    constraints.emplace_back(c);
+  }
+  fixed_body_derived = Derive(fixed_body, fixed_body_state);
+  external_forces.resize(scene.bodies.size());
+  for (size_t i = 0; i < scene.bodies.size(); ++i) {
+    const Body& body = scene.bodies[i];
+    bodies.emplace_back(body);
+    for (const auto& f: body.forces) {
+      external_forces[i].force += f.second;
+      external_forces[i].torque += (tvec3<T>(f.first) - state[i].pos).Cross(f.second);
+    }
+    external_forces[i].force += scene.gravity / body.inv_mass;
+  }
+}
+
 // According to [1], this method has only second order accuracy for rotations.
 // Still, it seems to perform somewhat better than MidpointMethod() in my experiments.
 // [1] http://euclid.ucsd.edu/~sbuss/ResearchWeb/accuraterotation/paper.pdf
-void RungeKutta4(StateVector& y, double h, function<void(const StateVector& y, StateVector& yp)> f)
-  __attribute__((unused));
-void RungeKutta4(StateVector& y, double h, function<void(const StateVector& y, StateVector& yp)> f) {
-  StateVector k1(y.size()), k2(y.size()), k3(y.size()), k4(y.size()), ty(y.size());
+template<typename S, typename F>
+void RungeKutta4(S& y, double h, F f) {
+  S k1(y.size()), k2(y.size()), k3(y.size()), k4(y.size()), ty(y.size());
   f(y, k1);
   f(ty.AddMul(y, h/2, k1), k2);
   f(ty.AddMul(y, h/2, k2), k3);
@@ -120,19 +240,25 @@ void MidpointMethod(valarray<double>& y, double h, function<void(const valarray<
 // try using Euler() instead of RungeKutta4() (also fewer substeps).
 // Torque-free precession of this single rotating box degrades in a few seconds with Euler():
 // scene.AddBody(MakeBox(dvec3(.2, .1, .3)).MultiplyMass(2700))->ang = dvec3(0,-1.24991,-0.758193);
-void Euler(StateVector& y, double h, function<void(const StateVector& y, StateVector& yp)> f)
-  __attribute__((unused));
-void Euler(StateVector& y, double h, function<void(const StateVector& y, StateVector& yp)> f) {
-  StateVector k(y.size());
+template<typename S, typename F>
+void Euler(S& y, double h, F f) {
+  S k(y.size());
   f(y, k);
   y.AddMul(y, h, k);
 }
 
 // Fills context.effective_forces.
-void ResolveForces(Scene& scene, const StateVector& state, Context& context) {
+template<typename T>
+void ResolveForces(const Scene& scene, const StateVector<T>& state, Context<T>& context) {
+  PerfRegion perf_region(context.profile ? &context.profile->resolve_forces : nullptr);
   size_t nvars = context.var_idx.back();
   auto& fv = context.force_from_vars;
-  fv.assign(scene.bodies.size() * 2 * (nvars + 1), dvec3(0, 0, 0));
+  fv.assign(scene.bodies.size() * 2 * (nvars + 1), tvec3<T>(0, 0, 0));
+
+  Derive(context.bodies, state, context.derived);
+  auto derived = [&](int body) -> const DerivedState<T>& {
+    return body == -1 ? context.fixed_body_derived : context.derived[body];
+  };
 
   for (size_t i = 0; i < scene.bodies.size(); ++i) {
     fv[(i*2 + 0)*(nvars+1) + nvars] = -context.external_forces[i].force;
@@ -142,28 +268,30 @@ void ResolveForces(Scene& scene, const StateVector& state, Context& context) {
   auto get_mask = [](Constraint::dof_t dofs) {
     return (uint8_t)((dofs / Constraint::DOF::PX) | (dofs / Constraint::DOF::RX));
   };
-  auto mat_to_vars = [&](const dmat3& m, size_t i, uint8_t msk) {
+  auto mat_to_vars = [&](const tmat3<T>& m, size_t i, uint8_t msk) {
     for (size_t j = 0; j < 3; ++j) {
       if (!(msk & (1 << j)))
         continue;
       fv[i++] += m.Column(j);
     }
   };
-  for (size_t i = 0; i < scene.constraints.size(); ++i) {
-    const Constraint& c = scene.constraints[i];
-    const BodyState& s1 = c.body1 == -1 ? fixed_body_state : state[c.body1];
-    const BodyState& s2 = state[c.body2];
+  for (size_t i = 0; i < context.constraints.size(); ++i) {
+    const ConstraintConstants<T>& c = context.constraints[i];
+    const TBodyState<T>& s1 = context.body_state(state, c.body1);
+    const TBodyState<T>& s2 = state[c.body2];
+    const DerivedState<T>& d1 = derived(c.body1);
+    const trot3<T>& rc = c.rot;
     size_t var = context.var_idx[i];
-    const dmat3 c2w = (s1.rot * c.rot1.Conjugate()).ToMatrix();
+    const tmat3<T> c2w = (s1.rot * c.rot1.Conjugate()).ToMatrix();
     if (auto pos_dof = get_mask(c.lock & Constraint::DOF::POS)) {
       if (c.body1 != -1)
         mat_to_vars(-c2w, c.body1*2*(nvars+1) + var, pos_dof);
       mat_to_vars(c2w, c.body2*2*(nvars+1) + var, pos_dof);
       // Body torque depends on constraint force too (not only on constraint torque).
-      dmat3 m = -s1.rot.ToMatrix() * c.pos1.Skew() * c.rot1.Conjugate().ToMatrix();
+      tmat3<T> m = -d1.rot.m * c.pos1.Skew() * rc.m.Transposed();
       if (c.body1 != -1)
         mat_to_vars(m, (c.body1*2 + 1)*(nvars+1) + var, pos_dof);
-      m = (s1.rot.Transform(c.pos1) + s1.pos - s2.pos).Skew() * (s1.rot * c.rot1.Conjugate()).ToMatrix();
+      m = (d1.rot.Rotate(c.pos1) + s1.pos - s2.pos).Skew() * c2w;
       mat_to_vars(m, (c.body2*2 + 1)*(nvars+1) + var, pos_dof);
       var += __builtin_popcount(pos_dof);
     }
@@ -178,40 +306,44 @@ void ResolveForces(Scene& scene, const StateVector& state, Context& context) {
   context.equations.Resize(nvars, nvars + 1);
   context.equations.Fill(0);
 
-  auto mat_to_equations = [&](const dmat3& m, size_t ei, size_t fi, Constraint::dof_t msk) {
+  auto mat_to_equations = [&](const tmat3<T>& m, size_t ei, size_t fi, Constraint::dof_t msk) {
     for (size_t j = 0; j <= nvars; ++j) {
-      dvec3 v = m * fv[fi + j];
+      tvec3<T> v = m * fv[fi + j];
       v.AddToArrayMasked(context.equations[ei] + j, msk, context.equations.Stride());
     }
   };
-  for (size_t i = 0; i < scene.constraints.size(); ++i) {
-    const Constraint& c = scene.constraints[i];
-    const Body& b1 = c.body1 == -1 ? fixed_body : scene.bodies[c.body1];
-    const Body& b2 = scene.bodies[c.body2];
-    const BodyState& s1 = c.body1 == -1 ? fixed_body_state : state[c.body1];
-    const BodyState& s2 = state[c.body2];
+  for (size_t i = 0; i < context.constraints.size(); ++i) {
+    const ConstraintConstants<T>& c = context.constraints[i];
+    const BodyConstants<T>& b1 = context.body(c.body1);
+    const BodyConstants<T>& b2 = context.body(c.body2);
+    const TBodyState<T>& s1 = context.body_state(state, c.body1);
+    const TBodyState<T>& s2 = state[c.body2];
+    const DerivedState<T>& d1 = derived(c.body1);
+    const DerivedState<T>& d2 = derived(c.body2);
+    const trot3<T>& rc = c.rot;
     size_t eq = context.var_idx[i];
-    dvec3 av1 = b1.inv_inertia * s1.rot.Untransform(s1.ang);
-    dvec3 av2 = b2.inv_inertia * s2.rot.Untransform(s2.ang);
+    const tvec3<T>& av1 = d1.av;
+    const tvec3<T>& av2 = d2.av;
     if (auto pos_dof = get_mask(c.lock & Constraint::DOF::POS)) {
+      // pos2 in body 1 space.
+      tvec3<T> p2 = d1.rot.Unrotate(d2.rot.Rotate(c.pos2)+s2.pos-s1.pos);
       // Second derivative of (2): add + cf1*force1 + cf2*force2 + ct1*torque1 + ct2*torque2.
-      dvec3 add = c.rot1.Transform((b1.inv_inertia*av1.Cross(s1.rot.Untransform(s1.ang)))
-                                   .Cross(s1.rot.Untransform(s2.rot.Transform(c.pos2)+s2.pos-s1.pos)) + // precession 1
-                                   av1.Cross(av1.Cross(s1.rot.Untransform(s2.rot.Transform(c.pos2)+s2.pos-s1.pos)) + // centripetal 1
-                                             -2.*s1.rot.Untransform(s2.rot.Transform(av2.Cross(c.pos2)) +
-                                                                    s2.momentum*b2.inv_mass - s1.momentum*b1.inv_mass)) + // Coriolis
-                                   s1.rot.Untransform(s2.rot.Transform(av2.Cross(av2.Cross(c.pos2)) + // centripetal 2
-                                                                       c.pos2.Cross(b2.inv_inertia*av2.Cross(s2.rot.Untransform(s2.ang))))) // precession 2
-                                   );
+      tvec3<T> add = rc.Rotate(d1.precession.Cross(p2) + // precession 1
+                               av1.Cross(av1.Cross(p2) + // centripetal 1
+                                         -2.*d1.rot.Unrotate(d2.rot.Rotate(av2.Cross(c.pos2)) +
+                                                             d2.velocity - d1.velocity)) + // Coriolis
+                               d1.rot.Unrotate(d2.rot.Rotate(av2.Cross(av2.Cross(c.pos2)) + // centripetal 2
+                                                             c.pos2.Cross(d2.precession))) // precession 2
+                               );
       (-add).AddToArrayMasked(context.equations[eq] + nvars, pos_dof, context.equations.Stride());
-      dmat3 cf2 = (c.rot1 * s1.rot.Conjugate()).ToMatrix();
-      dmat3 cf1 = cf2 * -b1.inv_mass;
+      tmat3<T> cf2 = (c.rot1 * s1.rot.Conjugate()).ToMatrix();
+      tmat3<T> cf1 = cf2 * -b1.inv_mass;
       cf2 *= b2.inv_mass;
       if (c.body1 != -1)
         mat_to_equations(cf1, eq, c.body1*2*(nvars+1), pos_dof);
       mat_to_equations(cf2, eq, c.body2*2*(nvars+1), pos_dof);
-      dmat3 ct1 = c.rot1.ToMatrix() * (s1.rot.Untransform(s2.rot.Transform(c.pos2)+s2.pos-s1.pos)).Skew() * b1.inv_inertia * s1.rot.Conjugate().ToMatrix();
-      dmat3 ct2 = -(c.rot1*s1.rot.Conjugate()*s2.rot).ToMatrix() * c.pos2.Skew() * b2.inv_inertia * s2.rot.Conjugate().ToMatrix();
+      tmat3<T> ct1 = rc.m * p2.Skew() * d1.world_to_av;
+      tmat3<T> ct2 = -(c.rot1*s1.rot.Conjugate()*s2.rot).ToMatrix() * c.pos2.Skew() * d2.world_to_av;
       if (c.body1 != -1)
         mat_to_equations(ct1, eq, (c.body1*2+1)*(nvars+1), pos_dof);
       mat_to_equations(ct2, eq, (c.body2*2+1)*(nvars+1), pos_dof);
@@ -219,12 +351,12 @@ void ResolveForces(Scene& scene, const StateVector& state, Context& context) {
     }
     if (auto rot_dof = get_mask(c.lock & Constraint::DOF::ROT)) {
       // Derivative of (1): add + ct1*torque1 + ct2*torque2.
-      dvec3 add = c.rot1.Transform(-av1.Cross(s1.rot.Untransform(s2.rot.Transform(av2)))+
-                                   -s1.rot.Untransform(s2.rot.Transform(b2.inv_inertia*av2.Cross(s2.rot.Untransform(s2.ang))))+
-                                   b1.inv_inertia*av1.Cross(s1.rot.Untransform(s1.ang)));
+      tvec3<T> add = rc.Rotate(-av1.Cross(d1.rot.Unrotate(d2.rot.Rotate(av2)))+
+                               -d1.rot.Unrotate(d2.rot.Rotate(d2.precession))+
+                               d1.precession);
       (-add).AddToArrayMasked(context.equations[eq] + nvars, rot_dof, context.equations.Stride());
-      dmat3 ct1 = -c.rot1.ToMatrix() * b1.inv_inertia * s1.rot.Conjugate().ToMatrix();
-      dmat3 ct2 = (c.rot1 * s1.rot.Conjugate() * s2.rot).ToMatrix() * b2.inv_inertia * s2.rot.Conjugate().ToMatrix();
+      tmat3<T> ct1 = -rc.m * d1.world_to_av;
+      tmat3<T> ct2 = (c.rot1 * s1.rot.Conjugate() * s2.rot).ToMatrix() * d2.world_to_av;
       if (c.body1 != -1)
         mat_to_equations(ct1, eq, (c.body1*2+1)*(nvars+1), rot_dof);
       mat_to_equations(ct2, eq, (c.body2*2+1)*(nvars+1), rot_dof);
@@ -232,8 +364,14 @@ void ResolveForces(Scene& scene, const StateVector& state, Context& context) {
     }
   }
 
-  bool ok = context.equations.SolveLinearSystem();
-  ++(ok ? scene.force_resolution_success : scene.force_resolution_failed);
+  bool ok;
+  {
+    PerfRegion perf_region(context.profile ? &context.profile->solve_linear_system : nullptr);
+    auto start = chrono::steady_clock::now();
+    ok = context.equations.SolveLinearSystem();
+    context.solver_seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  }
+  ++(ok ? context.force_resolution_success : context.force_resolution_failed);
 
   for (size_t i = 0; i < fv.size(); i += nvars+1) {
     for (size_t j = 0; j < nvars; ++j)
@@ -247,6 +385,38 @@ void ResolveForces(Scene& scene, const StateVector& state, Context& context) {
   }
 }
 
+// The time derivative of `y`.
+template<typename T>
+void Derivative(const Scene& scene, const StateVector<T>& y, StateVector<T>& yp, Context<T>& context) {
+  ResolveForces(scene, y, context);
+  for (size_t i = 0; i < y.size(); ++i) {
+    const DerivedState<T>& d = context.derived[i];
+    const TBodyState<T>& s = y[i];
+    TBodyState<T>& p = yp[i];
+    p.pos = d.velocity;
+    const tvec3<T>& av = d.av;
+    p.rot = s.rot * tquat<T>(0, av.x, av.y, av.z) * .5;
+    p.momentum = context.effective_forces[i].force;
+    p.ang = context.effective_forces[i].torque;
+  }
+}
+
+// The kSubsteps of PhysicsStep(dt), calling `after_substep(i)` after each.
+template<typename T, typename F>
+void Integrate(const Scene& scene, double dt, StateVector<T>& state, Context<T>& context, F after_substep) {
+  auto f = [&](const StateVector<T>& y, StateVector<T>& yp) {
+    Derivative(scene, y, yp, context);
+  };
+  for (int i = 0; i < kSubsteps; ++i) {
+    {
+      PerfRegion perf_region(context.profile ? &context.profile->runge_kutta : nullptr);
+      RungeKutta4(state, dt / kSubsteps, f);
+      //Euler(state, dt / kSubsteps, f);
+    }
+    after_substep(i);
+  }
+}
+
 } // namespace {
 
 // Prevent errors from accumulating by coercing the bodies into meeting all constraints,
@@ -277,36 +447,38 @@ void Scene::EnforceConstraints() {
       leaked_rotation += sqrt(l);
     }
 
+    // The rotations don't change from here on.
+    const drot3 r1(b1.rot), r2(b2.rot), rc(c.rot1);
+
     // Translation.
     {
-      dvec3 p = c.rot1.Transform(b1.rot.Untransform(b2.rot.Transform(c.pos2) + b2.pos - b1.pos) - c.pos1); // (2)
+      dvec3 p = rc.Rotate(r1.Unrotate(r2.Rotate(c.pos2) + b2.pos - b1.pos) - c.pos1); // (2)
       double l = clear_vec(p, Constraint::DOF::POS);
-      b2.pos = b1.rot.Transform(c.rot1.Untransform(p) + c.pos1) + b1.pos - b2.rot.Transform(c.pos2);
+      b2.pos = r1.Rotate(rc.Unrotate(p) + c.pos1) + b1.pos - r2.Rotate(c.pos2);
       leaked_translation += sqrt(l);
     }
 
     // Angular velocity.
     {
-      dvec3 w = c.rot1.Transform(b1.rot.Untransform(b2.rot.Transform(b2.inv_inertia * b2.rot.Untransform(b2.ang))) -
-                                 b1.inv_inertia * b1.rot.Untransform(b1.ang)); // (1)
+      dvec3 w = rc.Rotate(r1.Unrotate(r2.Rotate(b2.inv_inertia * r2.Unrotate(b2.ang))) -
+                          b1.inv_inertia * r1.Unrotate(b1.ang)); // (1)
       double l = clear_vec(w, Constraint::DOF::ROT);
-      b2.ang = b2.rot.Transform(b2.inv_inertia.Inverse() *
-                                b2.rot.Untransform(b1.rot.Transform(c.rot1.Untransform(w) +
-                                                                    b1.inv_inertia * b1.rot.Untransform(b1.ang))));
+      b2.ang = r2.Rotate(b2.inv_inertia.Inverse() *
+                         r2.Unrotate(r1.Rotate(rc.Unrotate(w) + b1.inv_inertia * r1.Unrotate(b1.ang))));
       leaked_angular_velocity += sqrt(l);
     }
 
     // Linear velocity.
     {
-      dvec3 av1 = b1.inv_inertia * b1.rot.Untransform(b1.ang);
-      dvec3 av2 = b2.inv_inertia * b2.rot.Untransform(b2.ang);
+      dvec3 av1 = b1.inv_inertia * r1.Unrotate(b1.ang);
+      dvec3 av2 = b2.inv_inertia * r2.Unrotate(b2.ang);
       dvec3 v0 =
-        -av1.Cross(b1.rot.Untransform(b2.rot.Transform(c.pos2)+b2.pos-b1.pos)) +
-        b1.rot.Untransform(b2.rot.Transform(av2.Cross(c.pos2)) - b1.momentum*b1.inv_mass);
+        -av1.Cross(r1.Unrotate(r2.Rotate(c.pos2)+b2.pos-b1.pos)) +
+        r1.Unrotate(r2.Rotate(av2.Cross(c.pos2)) - b1.momentum*b1.inv_mass);
       // Derivative of (2).
-      dvec3 v = c.rot1.Transform(v0 + b1.rot.Untransform(b2.momentum*b2.inv_mass));
+      dvec3 v = rc.Rotate(v0 + r1.Unrotate(b2.momentum*b2.inv_mass));
       double l = clear_vec(v, Constraint::DOF::POS);
-      b2.momentum = b1.rot.Transform((c.rot1.Untransform(v) - v0)) / b2.inv_mass;
+      b2.momentum = r1.Rotate((rc.Unrotate(v) - v0)) / b2.inv_mass;
       leaked_velocity += sqrt(l);
     }
   }
@@ -315,7 +487,7 @@ void Scene::EnforceConstraints() {
 double Scene::GetEnergy() const {
   double r = 0;
   for (const Body& b: bodies) {
-    dvec3 ang_in_body = b.rot.Untransform(b.ang);
+    dvec3 ang_in_body = b.rot.Unrotate(b.ang);
     r += .5 * (b.momentum.LengthSquare() * b.inv_mass + ang_in_body.Dot(b.inv_inertia * ang_in_body));
     r -= b.pos.Dot(gravity) / b.inv_mass;
   }
@@ -323,45 +495,47 @@ double Scene::GetEnergy() const {
 }
 
 void Scene::PhysicsStep(double dt) {
-  Context context;
-  context.var_idx.resize(constraints.size() + 1);
-  for (size_t i = 0; i < constraints.size(); ++i) {
-    size_t n = __builtin_popcount(constraints[i].lock);
-    context.var_idx[i + 1] = context.var_idx[i] + n;
-  }
-  context.external_forces.resize(bodies.size());
-  StateVector state_vec(bodies.size());
-  for (size_t i = 0; i < bodies.size(); ++i) {
-    Body& body = bodies[i];
-    for (const auto& f: body.forces) {
-      context.external_forces[i].force += f.second;
-      context.external_forces[i].torque += (f.first - body.pos).Cross(f.second);
-    }
-    context.external_forces[i].force += gravity / body.inv_mass;
-    state_vec[i].FromBody(body);
-  }
-  auto f = [&](const StateVector& y, StateVector& yp) {
-    ResolveForces(*this, y, context);
+  StateVector<double> state_vec(bodies.size());
+  for (size_t i = 0; i < bodies.size(); ++i)
+    state_vec[i].FromBody(bodies[i]);
+  Context<double> context(*this, state_vec);
+  context.profile = profile;
+  system_size = context.var_idx.back();
+  Integrate(*this, dt, state_vec, context, [&](int i) {
+    if (trajectory_sink)
+      trajectory_sink->OnSubstep(time + dt * (i + 1) / kSubsteps, state_vec.size(), state_vec.data());
+  });
+  substeps += kSubsteps;
+  time += dt;
+  solver_seconds += context.solver_seconds;
+  force_resolution_success += context.force_resolution_success;
+  force_resolution_failed += context.force_resolution_failed;
+  NormalizeRotations(state_vec);
+  for (size_t i = 0; i < bodies.size(); ++i)
+    state_vec[i].ToBody(bodies[i]);
+}
+
+void Scene::StepJacobian(double dt, DMatrix& jacobian) const {
+  // Differentiates by the components of one body per run. The spare direction makes the
+  // derivative loops of even length, which compilers vectorize without a scalar remainder.
+  const int n = BodyState::kComponents;
+  typedef tdual<double, n + 1> D;
+  jacobian.Resize(bodies.size() * n, bodies.size() * n);
+  for (size_t j = 0; j < bodies.size(); ++j) {
+    StateVector<D> state_vec(bodies.size());
+    for (size_t i = 0; i < bodies.size(); ++i)
+      state_vec[i].FromBody(bodies[i]);
+    for (int l = 0; l < n; ++l)
+      state_vec[j].Component(l).d[l] = 1;
+    Context<D> context(*this, state_vec);
+    Integrate(*this, dt, state_vec, context, [](int) {});
+    NormalizeRotations(state_vec);
     for (size_t i = 0; i < bodies.size(); ++i) {
-      const Body& body = bodies[i];
-      const BodyState& s = y[i];
-      BodyState& p = yp[i];
-      p.pos = s.momentum * body.inv_mass;
-      dvec3 av = body.inv_inertia * (s.rot.ToMatrix().Transposed() * s.ang);
-      p.rot = s.rot * fquat(0, av.x, av.y, av.z) * .5;
-      p.momentum = context.effective_forces[i].force;
-      p.ang = context.effective_forces[i].torque;
+      for (int k = 0; k < n; ++k) {
+        for (int l = 0; l < n; ++l)
+          jacobian[i*n + k][j*n + l] = state_vec[i].Component(k).d[l];
+      }
     }
-  };
-  const int steps = 100;
-  for (int i = 0; i < steps; ++i) {
-    RungeKutta4(state_vec, dt / steps, f);
-    //Euler(state_vec, dt / steps, f);
-  }
-  for (size_t i = 0; i < bodies.size(); ++i) {
-    Body& body = bodies[i];
-    state_vec[i].ToBody(body);
-    body.rot.NormalizeMe();
   }
 }
 
@@ -380,7 +554,7 @@ Constraint* Scene::AddConstraint(int body1, int body2, dvec3 pos2, dquat rot2, C
   c.body2 = body2;
   c.pos2 = pos2;
   c.rot2 = rot2;
-  c.pos1 = b1.rot.Untransform((b2.rot.Transform(pos2) + b2.pos) - b1.pos);
+  c.pos1 = b1.rot.Unrotate((b2.rot.Rotate(pos2) + b2.pos) - b1.pos);
   c.rot1 = rot2 * b2.rot.Conjugate() * b1.rot;
 
   constraints.push_back(c);
@@ -0,0 +1,133 @@
+#include "sim/physics-thread.h"
+#include "sim/snapshot.h"
+using namespace std;
+
+// Queue sizes, in inputs. The physics thread drains both queues before every step,
+// so they only fill up if it's stuck.
+static const size_t kForceQueueSize = 256;
+static const size_t kCommandQueueSize = 64;
+// How far the thread may fall behind real time before it gives up catching up.
+static const int kMaxLagSteps = 4;
+
+void PhysicsThread::Frame::Apply(Scene& scene, double extrapolate) const {
+  for (size_t i = 0; i < states.size() && i < scene.bodies.size(); ++i) {
+    Body& b = scene.bodies[i];
+    const BodyState& s = states[i];
+    b.pos = s.pos;
+    b.rot = s.rot;
+    if (extrapolate <= 0 || b.inv_mass == 0)
+      continue;
+    // One Euler step of the velocity part of Scene::PhysicsStep()'s derivative; forces are ignored.
+    b.pos += s.momentum * (b.inv_mass * extrapolate);
+    dvec3 av = b.inv_inertia * (s.rot.ToMatrix().Transposed() * s.ang);
+    b.rot += s.rot * dquat(0, av.x, av.y, av.z) * (.5 * extrapolate);
+    b.rot.NormalizeMe();
+  }
+}
+
+PhysicsThread::PhysicsThread(const Scene& scene, double step)
+  : step_(step), forces_(kForceQueueSize), commands_(kCommandQueueSize) {
+  SceneSnapshot(scene).Restore(scene_);
+  Publish();
+  frames_.Update();
+}
+
+PhysicsThread::~PhysicsThread() {
+  Stop();
+}
+
+void PhysicsThread::Start() {
+  stop_ = false;
+  thread_ = thread(&PhysicsThread::Run, this);
+}
+
+void PhysicsThread::Stop() {
+  if (!thread_.joinable())
+    return;
+  stop_ = true;
+  thread_.join();
+}
+
+bool PhysicsThread::SetForce(int body, dvec3 force, chrono::steady_clock::time_point sampled) {
+  return forces_.TryPush(ForceInput{body, force, sampled});
+}
+
+void PhysicsThread::Post(function<void(Scene&)> command) {
+  function<void(Scene&)>* slot;
+  while (!(slot = commands_.BeginPush()))
+    this_thread::yield();
+  *slot = std::move(command);
+  commands_.EndPush();
+}
+
+void PhysicsThread::Publish() {
+  Frame& f = frames_.back();
+  f.time = scene_.time;
+  f.published = chrono::steady_clock::now();
+  f.input_sampled = input_sampled_;
+  f.states.resize(scene_.bodies.size());
+  for (size_t i = 0; i < scene_.bodies.size(); ++i)
+    f.states[i].FromBody(scene_.bodies[i]);
+  f.steps = steps_;
+  f.step_seconds = step_seconds_;
+  f.solver_seconds = solver_seconds_;
+  f.substeps = scene_.substeps;
+  f.system_size = scene_.system_size;
+  f.leaked_translation = scene_.leaked_translation;
+  f.leaked_rotation = scene_.leaked_rotation;
+  f.leaked_velocity = scene_.leaked_velocity;
+  f.leaked_angular_velocity = scene_.leaked_angular_velocity;
+  frames_.Publish();
+}
+
+void PhysicsThread::Run() {
+  using clock = chrono::steady_clock;
+  clock::duration period = chrono::duration_cast<clock::duration>(chrono::duration<double>(step_));
+  // Forces set with SetForce(), by body index; the point of application follows the body.
+  vector<bool> has_force(scene_.bodies.size());
+  vector<dvec3> forces(scene_.bodies.size());
+
+  clock::time_point next = clock::now();
+  while (!stop_.load(memory_order_relaxed)) {
+    while (function<void(Scene&)>* c = commands_.Front()) {
+      (*c)(scene_);
+      *c = nullptr; // release captures now rather than when the slot is reused
+      commands_.Pop();
+    }
+    while (ForceInput* f = forces_.Front()) {
+      if (f->body >= 0 && f->body < (int)forces.size()) {
+        has_force[f->body] = true;
+        forces[f->body] = f->force;
+      }
+      input_sampled_ = max(input_sampled_, f->sampled);
+      forces_.Pop();
+    }
+    for (size_t i = 0; i < forces.size(); ++i) {
+      if (!has_force[i])
+        continue;
+      Body& b = scene_.bodies[i];
+      b.forces.clear();
+      b.forces.emplace_back(b.pos, forces[i]);
+    }
+
+    if (before_step)
+      before_step(scene_, step_);
+    clock::time_point start = clock::now();
+    double solver_before = scene_.solver_seconds;
+    scene_.PhysicsStep(step_);
+    step_seconds_ = chrono::duration<double>(clock::now() - start).count();
+    solver_seconds_ = scene_.solver_seconds - solver_before;
+    ++steps_;
+    Publish();
+
+    next += period;
+    clock::time_point now = clock::now();
+    if (now > next + kMaxLagSteps * period) {
+      // Too slow for real time: drop the backlog instead of stepping without pause forever.
+      overruns_.fetch_add(1, memory_order_relaxed);
+      next = now;
+    } else {
+      this_thread::sleep_until(next);
+    }
+  }
+}
@@ -0,0 +1,122 @@
+#pragma once
+#include "sim/scene.h"
+#include "util/spsc-queue.h"
+#include "util/triple-buffer.h"
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <vector>
+
+// Runs the simulation of a Scene on its own thread at a fixed rate, so that slow physics
+// steps don't delay frames and vsync waits don't delay physics.
+//
+// The thread owns a private copy of the scene, made with SceneSnapshot; the caller keeps
+// its own scene for rendering and copies body states from the latest Frame into it:
+//   PhysicsThread physics(scene);
+//   physics.Start();
+//   ...every frame:
+//   physics.SetForce(box->idx, f);
+//   physics.Update();
+//   physics.frame().Apply(scene);
+//   scene.Render();
+//
+// States go to the renderer through a triple buffer and forces come back through a queue;
+// neither side ever blocks on the other.
+class PhysicsThread {
+ public:
+  // State of all bodies after one step.
+  struct Frame {
+    double time = 0; // Scene::time
+    std::chrono::steady_clock::time_point published; // wall time when the step finished
+    // When the newest input applied before the step was sampled (see SetForce()); default
+    // if there was none.
+    std::chrono::steady_clock::time_point input_sampled;
+    std::vector<BodyState> states;
+    size_t steps = 0; // steps made so far
+
+    // Stats, e.g. for a HUD.
+    double step_seconds = 0; // wall time of the last step
+    double solver_seconds = 0; // part of it spent solving for constraint forces
+    size_t substeps = 0; // Scene::substeps
+    size_t system_size = 0; // Scene::system_size
+    // Scene::leaked_* totals.
+    double leaked_translation = 0;
+    double leaked_rotation = 0;
+    double leaked_velocity = 0;
+    double leaked_angular_velocity = 0;
+
+    // Copies positions and rotations to bodies of `scene`, moved `extrapolate` seconds ahead
+    // at their current velocities. That stands in for the physics from the end of the step to
+    // when the frame is seen, without a step of its own on the render thread.
+    void Apply(Scene& scene, double extrapolate = 0) const;
+  };
+
+  // `step` is the simulated (and wall clock) time per PhysicsStep().
+  explicit PhysicsThread(const Scene& scene, double step = 1./120);
+  // Calls Stop().
+  ~PhysicsThread();
+
+  PhysicsThread(const PhysicsThread& rhs) = delete;
+  PhysicsThread& operator=(const PhysicsThread& rhs) = delete;
+
+  // Called on the physics thread right before every step, e.g. for InputRecorder::RecordStep().
+  // Set before Start().
+  std::function<void(Scene& scene, double dt)> before_step;
+
+  void Start();
+  // Waits for the current step to finish. Commands posted and not yet run are dropped.
+  void Stop();
+
+  // Physics thread's scene. Only touch it when the thread is not running,
+  // e.g. to set Scene::trajectory_sink before Start().
+  Scene& scene() {
+    return scene_;
+  }
+
+  // Replaces forces of `body` with `force` applied at its center of mass, from the next step on.
+  // `sampled` is when the input behind it was read, for Frame::input_sampled.
+  // Wait-free; returns false if the queue is full (physics is far behind), in which case
+  // the input is dropped.
+  bool SetForce(int body, dvec3 force,
+                std::chrono::steady_clock::time_point sampled = std::chrono::steady_clock::now());
+  // Runs `command` on the physics thread between steps, e.g. to reset bodies or save a snapshot.
+  // Blocks only if the command queue is full.
+  void Post(std::function<void(Scene& scene)> command);
+
+  // Takes the latest published frame, if there's a new one. Render thread only.
+  bool Update() {
+    return frames_.Update();
+  }
+  const Frame& frame() const {
+    return frames_.front();
+  }
+
+  // Number of times the thread fell more than a few steps behind real time and skipped ahead.
+  size_t overruns() const {
+    return overruns_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  struct ForceInput {
+    int body;
+    dvec3 force;
+    std::chrono::steady_clock::time_point sampled;
+  };
+
+  Scene scene_;
+  double step_;
+  std::thread thread_;
+  std::atomic<bool> stop_{false};
+  std::atomic<size_t> overruns_{0};
+  size_t steps_ = 0;
+  double step_seconds_ = 0; // of the last step
+  double solver_seconds_ = 0;
+  std::chrono::steady_clock::time_point input_sampled_; // newest among applied inputs
+  SpscQueue<ForceInput> forces_;
+  SpscQueue<std::function<void(Scene&)>> commands_;
+  TripleBuffer<Frame> frames_;
+
+  void Run();
+  void Publish();
+};
@@ -0,0 +1,134 @@
+#include "sim/recording.h"
+#include <cassert>
+#include <sstream>
+using namespace std;
+
+static const char kMagic[8] = {'C', 'U', 'B', 'E', 'R', 'E', 'C', 0};
+static const uint32_t kVersion = 1;
+
+static void WriteState(BinaryWriter& w, const Scene& scene) {
+  w.Write<char>('S');
+  w.Write<uint32_t>(scene.bodies.size());
+  for (const Body& b: scene.bodies) {
+    w.Write(b.pos);
+    w.Write(b.rot);
+    w.Write(b.momentum);
+    w.Write(b.ang);
+  }
+}
+
+static void ReadState(BinaryReader& r, Scene& scene) {
+  if (r.Read<uint32_t>() != scene.bodies.size())
+    throw IOException("recording doesn't match the scene: different number of bodies");
+  for (Body& b: scene.bodies) {
+    b.pos = r.ReadVec3();
+    b.rot = r.ReadQuat();
+    b.momentum = r.ReadVec3();
+    b.ang = r.ReadVec3();
+  }
+}
+
+InputRecorder::InputRecorder(const string& path): out_(path, ios::binary) {
+  if (!out_)
+    throw IOException("couldn't open " + path + " for writing");
+  buf_.WriteBytes(kMagic, sizeof(kMagic));
+  buf_.Write(kVersion);
+  Flush();
+}
+
+InputRecorder::~InputRecorder() {}
+
+void InputRecorder::Flush() {
+  out_.write(buf_.data().data(), buf_.size());
+  buf_.Clear();
+  if (!out_)
+    throw IOException("failed to write recording");
+}
+
+void InputRecorder::RecordState(const Scene& scene) {
+  assert(!finished_);
+  WriteState(buf_, scene);
+  Flush();
+}
+
+void InputRecorder::RecordStep(const Scene& scene, double dt) {
+  assert(!finished_);
+  BinaryWriter f;
+  f.Write<char>('F');
+  f.Write<uint32_t>(scene.bodies.size());
+  for (const Body& b: scene.bodies) {
+    f.Write<uint32_t>(b.forces.size());
+    for (const auto& force: b.forces) {
+      f.Write(force.first);
+      f.Write(force.second);
+    }
+  }
+  if (f.data() != last_forces_) {
+    buf_.WriteBytes(f.data().data(), f.size());
+    last_forces_ = f.data();
+  }
+  buf_.Write<char>('T');
+  buf_.Write(dt);
+  ++steps_;
+  Flush();
+}
+
+void InputRecorder::Finish(const Scene& scene) {
+  assert(!finished_);
+  buf_.Write<char>('E');
+  WriteState(buf_, scene);
+  Flush();
+  out_.flush();
+  finished_ = true;
+}
+
+InputReplayer::InputReplayer(const string& path) {
+  ifstream in(path, ios::binary);
+  if (!in)
+    throw IOException("couldn't open " + path);
+  stringstream ss;
+  ss << in.rdbuf();
+  data_ = ss.str();
+}
+
+bool InputReplayer::Run(Scene& scene) {
+  BinaryReader r(data_.data(), data_.size());
+  if (memcmp(r.Skip(sizeof(kMagic)), kMagic, sizeof(kMagic)))
+    throw IOException("not a recording");
+  if (r.Read<uint32_t>() != kVersion)
+    throw IOException("unsupported recording version");
+  steps_ = 0;
+  while (true) {
+    char tag = r.Read<char>();
+    switch (tag) {
+      case 'S':
+        ReadState(r, scene);
+        break;
+      case 'F': {
+        if (r.Read<uint32_t>() != scene.bodies.size())
+          throw IOException("recording doesn't match the scene: different number of bodies");
+        for (Body& b: scene.bodies) {
+          b.forces.resize(r.Read<uint32_t>());
+          for (auto& force: b.forces) {
+            force.first = r.ReadVec3();
+            force.second = r.ReadVec3();
+          }
+        }
+        break;
+      }
+      case 'T':
+        scene.PhysicsStep(r.Read<double>());
+        ++steps_;
+        break;
+      case 'E': {
+        // Compare serialized states to compare bitwise (and to treat equal NaNs as equal).
+        BinaryWriter actual;
+        WriteState(actual, scene);
+        const char* expected = r.Skip(actual.size());
+        return !memcmp(expected, actual.data().data(), actual.size());
+      }
+      default:
+        throw IOException("corrupted recording: unknown record " + to_string((int)tag));
+    }
+  }
+}
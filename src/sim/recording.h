@@ -0,0 +1,63 @@
+#pragma once
+#include "sim/scene.h"
+#include "util/binary-io.h"
+#include <fstream>
+#include <string>
+
+// Records everything that drives a Scene from outside during an interactive session
+// (per-frame dt, external forces, manual state changes like resets), so that the
+// session can be reproduced exactly and as fast as possible without a window.
+//
+// File format: "CUBEREC\0", uint32 version, then a sequence of records, each starting with a tag byte:
+//  'S' - state of all bodies (uint32 count, then pos, rot, momentum, ang of each body),
+//  'F' - forces of all bodies (uint32 count, for each body uint32 number of forces, then point and force of each),
+//        only written if they changed since the previous frame,
+//  'T' - physics step (double dt),
+//  'E' - end; followed by the final 'S' state that the replay is compared against.
+class InputRecorder {
+ public:
+  explicit InputRecorder(const std::string& path);
+  ~InputRecorder();
+
+  InputRecorder(const InputRecorder& rhs) = delete;
+  InputRecorder& operator=(const InputRecorder& rhs) = delete;
+
+  // Record the current state of all bodies. Call at the start and after changing bodies manually (e.g. reset).
+  void RecordState(const Scene& scene);
+  // Call right before scene.PhysicsStep(dt), after setting the forces.
+  void RecordStep(const Scene& scene, double dt);
+  // Writes the final state. Nothing can be recorded after that.
+  void Finish(const Scene& scene);
+
+  size_t steps() const {
+    return steps_;
+  }
+
+ private:
+  std::ofstream out_;
+  BinaryWriter buf_;
+  std::string last_forces_;
+  bool finished_ = false;
+  size_t steps_ = 0;
+
+  void Flush();
+};
+
+// Replays a recording made by InputRecorder.
+class InputReplayer {
+ public:
+  explicit InputReplayer(const std::string& path);
+
+  // `scene` must have the same bodies and constraints as the recorded one,
+  // e.g. be built by the same code. Runs the whole recording as fast as possible.
+  // Returns true if the final state is bitwise identical to the recorded one.
+  bool Run(Scene& scene);
+
+  size_t steps() const {
+    return steps_;
+  }
+
+ private:
+  std::string data_;
+  size_t steps_ = 0;
+};
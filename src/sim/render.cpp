@@ -1,4 +1,7 @@
 #include "sim/scene.h"
+#include "sim/mesh-build.h"
+#include "util/frustum.h"
+#include "util/quat-arrays.h"
 #include "gl-util/gl-common.h"
 using namespace std;
 
@@ -23,53 +26,249 @@ fmat4 Camera::ViewProjection() const {
 
 static const char* vertex_shader = R"(
   #version 330 core
-  layout(location = 0) in vec3 vert_pos;
-  layout(location = 1) in vec3 vert_normal;
-  layout(location = 2) in vec3 vert_color;
-  uniform mat4 model_mat;
-  uniform mat4 view_proj_mat;
+  layout(location = 0) in vec3 vert_pos; // [0, 1] within mesh bounds, see PackedVertex
+  layout(location = 1) in vec4 vert_normal;
+  layout(location = 2) in vec4 vert_color;
+  layout(location = 3) in vec4 model_row0; // per instance
+  layout(location = 4) in vec4 model_row1;
+  layout(location = 5) in vec4 model_row2;
+  layout(location = 6) in vec4 model_row3;
+  layout(location = 7) in vec3 inst_tint;
+  layout(location = 8) in vec3 pos_offset;
+  layout(location = 9) in vec3 pos_scale;
+  layout(std140, row_major) uniform Frame {
+    mat4 view_proj_mat;
+    vec3 light_vec;
+    float time;
+  };
   out vec3 normal;
   out vec3 color;
+  flat out vec3 tint_color;
   void main(){
-    vec4 p = model_mat * vec4(vert_pos, 1);
-    normal = (model_mat * vec4(vert_normal, 0)).xyz;
-    color = vert_color;
+    mat4 model_mat = transpose(mat4(model_row0, model_row1, model_row2, model_row3));
+    vec4 p = model_mat * vec4(pos_offset + vert_pos * pos_scale, 1);
+    normal = (model_mat * vec4(vert_normal.xyz, 0)).xyz;
+    color = vert_color.rgb;
+    tint_color = inst_tint;
     gl_Position =  view_proj_mat * p;
   }
 )";
 
 static const char* fragment_shader = R"(
   #version 330 core
-  uniform vec3 light_vec;
-  uniform vec3 tint_color;
-  uniform float time;
+  layout(std140, row_major) uniform Frame {
+    mat4 view_proj_mat;
+    vec3 light_vec;
+    float time;
+  };
   in vec3 normal;
   in vec3 color;
+  flat in vec3 tint_color;
   out vec3 frag_color;
   void main(){
     frag_color = color * (.05 + max(0.f, dot(light_vec, normalize(normal)))) + tint_color * sin(time);
   }
 )";
 
-Scene::Scene(): shader_("vert", "frag", vertex_shader, fragment_shader) {}
+// std140 layout of the `Frame` uniform block.
+struct FrameUniforms {
+  float view_proj_mat[16]; // rows of fmat4
+  fvec3 light_vec;
+  float time;
+};
+static_assert(sizeof(FrameUniforms) == 80, "FrameUniforms doesn't match std140 layout");
+static const GLuint kFrameUniformsBinding = 0;
+
+Scene::Scene() {}
+
+static void UploadMesh(Mesh& mesh, GL::MeshArena& arena) {
+  IndexedMesh indexed = BuildIndexedMesh(mesh.vertices);
+  PackedMesh packed = PackVertices(indexed.vertices);
+  mesh.pos_offset = packed.pos_offset;
+  mesh.pos_scale = packed.pos_scale;
+  mesh.range = arena.Add(packed.vertices.size(), packed.vertices.data(), indexed.indices.size(), indexed.indices.data());
+  mesh.uploaded = true;
+}
+
+// Model matrix as four row attributes, then tint and dequantization.
+static const GL::VertexArray::Format& InstanceFormat() {
+  static GL::VertexArray::Format format = [] {
+    GL::VertexArray::Format f(sizeof(MeshInstance), 1);
+    for (int i = 0; i < 4; ++i)
+      f.Add(3 + i, 4, GL_FLOAT, offsetof(MeshInstance, model_mat) + i * 4 * sizeof(float));
+    f.Add(7, 3, GL_FLOAT, offsetof(MeshInstance, tint));
+    f.Add(8, 3, GL_FLOAT, offsetof(MeshInstance, pos_offset));
+    f.Add(9, 3, GL_FLOAT, offsetof(MeshInstance, pos_scale));
+    return f;
+  }();
+  return format;
+}
 
 void Scene::Render() {
+  if (!shader_) {
+    shader_.reset(new GL::Shader("vert", "frag", vertex_shader, fragment_shader, program_cache));
+    shader_->BindUniformBlock("Frame", kFrameUniformsBinding);
+    frame_uniforms_.reset(new GL::UniformBuffer(sizeof(FrameUniforms)));
+    mesh_arena_.reset(new GL::MeshArena(PackedVertex::Format()));
+    instance_stream_.reset(new GL::StreamBuffer(max<size_t>(bodies.size(), 64) * sizeof(MeshInstance)));
+  }
+
   glClearColor(.5, .5, 1, 0);
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
   glEnable(GL_DEPTH_TEST);
   glDepthFunc(GL_LESS);
   //glEnable(GL_CULL_FACE);
-  shader_.Use();
-  shader_.SetVec3("light_vec", light_vec);
+  shader_->Use();
+
+  FrameUniforms frame;
+  fmat4 view_proj = camera.ViewProjection();
+  memcpy(frame.view_proj_mat, view_proj.m, sizeof(frame.view_proj_mat));
+  frame.light_vec = light_vec;
   double t = std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now().time_since_epoch()).count();
   t -= floor(t/(3600*24))*(3600*24);
-  shader_.SetScalar("time", t);
-  shader_.SetMat4("view_proj_mat", camera.ViewProjection());
-  for (auto& body: bodies) {
-    shader_.SetVec3("tint_color", body.mesh.tint);
-    shader_.SetMat4("model_mat", fmat4::Translation(body.pos) * body.rot.ToMatrix4());
-    body.mesh.vao->Draw();
+  frame.time = t;
+  frame_uniforms_->Set(frame);
+  frame_uniforms_->Bind(kFrameUniformsBinding);
+
+  // Bounding spheres are around the center of mass, so they don't depend on rotation.
+  cull_x_.clear();
+  cull_y_.clear();
+  cull_z_.clear();
+  cull_r_.clear();
+  cull_rot_.clear();
+  cull_bodies_.clear();
+  for (const Body& body: bodies) {
+    if (body.mesh < 0)
+      continue;
+    cull_x_.push_back(body.pos.x);
+    cull_y_.push_back(body.pos.y);
+    cull_z_.push_back(body.pos.z);
+    cull_r_.push_back(meshes[body.mesh].radius);
+    cull_rot_.push_back(fquat(body.rot));
+    cull_bodies_.push_back(&body);
+  }
+  visible_.resize(cull_bodies_.size());
+  Frustum(view_proj).CullSpheres(cull_bodies_.size(), cull_x_.data(), cull_y_.data(), cull_z_.data(), cull_r_.data(), visible_.data());
+
+  // Level of detail from the projected radius of bounding sphere: radius * proj_scale / w,
+  // where w is the clip space w (distance along the view direction). Camera::fov is horizontal.
+  GLint viewport[4];
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  float proj_scale = viewport[2] * .5f / tan(camera.fov / 2);
+  fvec3 w_row(view_proj.m[12], view_proj.m[13], view_proj.m[14]);
+  float w_offset = view_proj.m[15];
+
+  // Choose meshes and count instances of each.
+  for (Mesh& mesh: meshes)
+    mesh.instance_count = 0;
+  draw_mesh_.resize(cull_bodies_.size());
+  culled_bodies = 0;
+  for (size_t i = 0; i < cull_bodies_.size(); ++i) {
+    if (!visible_[i]) {
+      draw_mesh_[i] = -1;
+      ++culled_bodies;
+      continue;
+    }
+    const Body& body = *cull_bodies_[i];
+    int m = body.mesh;
+    float w = w_row.Dot(fvec3(body.pos)) + w_offset;
+    float pixels = w > 0 ? meshes[m].radius * proj_scale / w : 0;
+    for (float limit = lod_radius_pixels; pixels < limit && meshes[m].coarser >= 0; limit /= 2)
+      m = meshes[m].coarser;
+    draw_mesh_[i] = m;
+    ++meshes[m].instance_count;
+  }
+
+  // One draw command per used mesh, instances grouped by mesh.
+  draw_commands_.clear();
+  wide_commands_.clear();
+  drawn_triangles = 0;
+  size_t total = 0;
+  for (Mesh& mesh: meshes) {
+    mesh.first_instance = total;
+    total += mesh.instance_count;
+    if (!mesh.instance_count)
+      continue;
+    if (!mesh.uploaded)
+      UploadMesh(mesh, *mesh_arena_);
+    GL::MeshArena::DrawCommand c;
+    c.index_count = mesh.range.index_count;
+    c.instance_count = mesh.instance_count;
+    c.first_index = mesh.range.first_index;
+    c.base_vertex = mesh.range.base_vertex;
+    c.base_instance = mesh.first_instance;
+    (mesh.range.index_type == GL_UNSIGNED_SHORT ? draw_commands_ : wide_commands_).push_back(c);
+    drawn_triangles += mesh.instance_count * mesh.range.index_count / 3;
+  }
+  size_t narrow_commands = draw_commands_.size();
+  draw_commands_.insert(draw_commands_.end(), wide_commands_.begin(), wide_commands_.end());
+  draw_commands = draw_commands_.size();
+  draw_calls = 0;
+  if (!total)
+    return;
+  model_mats_.resize(cull_bodies_.size());
+  ModelMatrices(cull_bodies_.size(), cull_x_.data(), cull_y_.data(), cull_z_.data(), cull_rot_.data(),
+                model_mats_.data());
+
+  // Write commands and instances straight into the stream buffer.
+  // `instance_count` is reused as the fill position and ends up where it started.
+  size_t commands_bytes = draw_commands_.size() * sizeof(draw_commands_[0]);
+  char* stream = (char*)instance_stream_->Begin(commands_bytes + total * sizeof(MeshInstance));
+  memcpy(stream, draw_commands_.data(), commands_bytes);
+  MeshInstance* instances = (MeshInstance*)(stream + commands_bytes);
+  for (Mesh& mesh: meshes)
+    mesh.instance_count = 0;
+  for (size_t i = 0; i < cull_bodies_.size(); ++i) {
+    if (draw_mesh_[i] < 0)
+      continue;
+    const Body& body = *cull_bodies_[i];
+    Mesh& mesh = meshes[draw_mesh_[i]];
+    MeshInstance& inst = instances[mesh.first_instance + mesh.instance_count++];
+    memcpy(inst.model_mat, model_mats_[i].m, sizeof(inst.model_mat));
+    inst.tint = body.tint;
+    inst.pos_offset = mesh.pos_offset;
+    inst.pos_scale = mesh.pos_scale;
+  }
+  size_t offset = instance_stream_->End();
+
+  mesh_arena_->SetInstanceAttributes(InstanceFormat(), instance_stream_->buffer(), offset + commands_bytes);
+  draw_calls = mesh_arena_->MultiDraw(GL_UNSIGNED_SHORT, draw_commands_.data(), narrow_commands,
+                                      instance_stream_->buffer(), offset);
+  draw_calls += mesh_arena_->MultiDraw(GL_UNSIGNED_INT, draw_commands_.data() + narrow_commands,
+                                       draw_commands_.size() - narrow_commands, instance_stream_->buffer(),
+                                       offset + narrow_commands * sizeof(draw_commands_[0]));
+}
+
+// FNV-1a.
+static uint64_t HashVertices(const vector<BodyEdit::Vertex>& vertices) {
+  const unsigned char* p = (const unsigned char*)vertices.data();
+  size_t n = vertices.size() * sizeof(vertices[0]);
+  uint64_t h = 14695981039346656037ull;
+  for (size_t i = 0; i < n; ++i) {
+    h ^= p[i];
+    h *= 1099511628211ull;
   }
+  return h;
+}
+
+int Scene::AddMesh(vector<BodyEdit::Vertex> vertices, int coarser) {
+  uint64_t hash = HashVertices(vertices);
+  auto range = mesh_by_hash_.equal_range(hash);
+  for (auto it = range.first; it != range.second; ++it) {
+    const Mesh& m = meshes[it->second];
+    const vector<BodyEdit::Vertex>& v = m.vertices;
+    if (m.coarser == coarser && v.size() == vertices.size() && !memcmp(v.data(), vertices.data(), v.size() * sizeof(v[0])))
+      return it->second;
+  }
+  meshes.emplace_back();
+  Mesh& mesh = meshes.back();
+  mesh.vertices = std::move(vertices);
+  mesh.coarser = coarser;
+  for (const BodyEdit::Vertex& v: mesh.vertices)
+    mesh.radius = max(mesh.radius, v.pos.Length());
+  int idx = meshes.size() - 1;
+  mesh_by_hash_.emplace(hash, idx);
+  return idx;
 }
 
 Body* Scene::AddBody() {
@@ -81,23 +280,14 @@ Body* Scene::AddBody(BodyEdit edit) {
   edit.Translate(-edit.com);
   Body* b = AddBody();
 
-  struct Vertex {
-    fvec3 pos;
-    fvec3 normal;
-    fvec3 color;
-  };
-
   b->inv_mass = 1/edit.mass;
   b->inv_inertia = edit.inertia.Inverse();
-  b->mesh.vao.reset(new GL::VertexArray(edit.vertices.size()));
-
-  using Attribute = GL::VertexArray::Attribute;
-  vector<Attribute> attrs = {
-    Attribute(0, 3, GL_FLOAT, sizeof(BodyEdit::Vertex), offsetof(BodyEdit::Vertex, pos)),
-    Attribute(1, 3, GL_FLOAT, sizeof(BodyEdit::Vertex), offsetof(BodyEdit::Vertex, normal)),
-    Attribute(2, 3, GL_FLOAT, sizeof(BodyEdit::Vertex), offsetof(BodyEdit::Vertex, color)),
-  };
-  b->mesh.vao->AddAttributes(attrs.size(), &attrs[0], edit.vertices.size() * sizeof(edit.vertices[0]), &edit.vertices[0]);
+  if (!edit.vertices.empty()) {
+    int mesh = -1;
+    for (size_t i = edit.coarser.size(); i > 0; --i)
+      mesh = AddMesh(std::move(edit.coarser[i - 1]), mesh);
+    b->mesh = AddMesh(std::move(edit.vertices), mesh);
+  }
 
   return b;
 }
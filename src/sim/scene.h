@@ -1,12 +1,19 @@
 #pragma once
 #include "util/vec.h"
 #include "util/quat.h"
+#include "util/linear.h"
 #include "gl-util/gl-common.h"
 #include "gl-util/vertex-array.h"
 #include "gl-util/shader.h"
+#include "gl-util/uniform-buffer.h"
+#include "gl-util/stream-buffer.h"
+#include "gl-util/mesh-arena.h"
+#include "util/perf-counters.h"
 #include <vector>
 #include <list>
 #include <deque>
+#include <unordered_map>
+#include <cstring>
 
 // The implementation of functions declared here is somewhat arbitrarily split between render.cpp and phys.cpp.
 
@@ -26,6 +33,9 @@ class BodyEdit {
   };
 
   std::vector<Vertex> vertices;
+  // Optional coarser versions of `vertices` for bodies that are small on screen, each with
+  // about half the detail of the previous one. All transformations apply to them too.
+  std::vector<std::vector<Vertex>> coarser;
   double mass;
   dvec3 com; // center of mass
   dmat3 inertia; // around center of mass
@@ -38,12 +48,51 @@ class BodyEdit {
   BodyEdit& Translate(dvec3 d);
   BodyEdit& Rotate(dquat q);
   BodyEdit& Scale(double factor);
+
+  // Level 0 is `vertices`; levels past the coarsest available give the coarsest.
+  const std::vector<Vertex>& Level(size_t level) const {
+    return level == 0 || coarser.empty() ? vertices : coarser[std::min(level, coarser.size()) - 1];
+  }
+
+ private:
+  template<typename F>
+  void ForEachVertex(F f) {
+    for (Vertex& v: vertices)
+      f(v);
+    for (auto& level: coarser)
+      for (Vertex& v: level)
+        f(v);
+  }
+};
+
+// Per-instance data for instanced drawing of a mesh.
+struct MeshInstance { // directly copied to opengl vertex buffer object
+  float model_mat[16]; // rows of fmat4
+  fvec3 tint;
+  // Dequantization of the mesh's PackedVertex positions, so that one multi-draw can cover all meshes.
+  fvec3 pos_offset;
+  fvec3 pos_scale;
 };
 
+// Geometry shared by all bodies with identical vertices, see Scene::AddMesh().
 class Mesh {
  public:
-  fvec3 tint = fvec3(0, 0, 0);
-  std::unique_ptr<GL::VertexArray> vao;
+  // Triangle soup, 3 vertices per triangle. Welded into an indexed mesh and uploaded to the
+  // scene's mesh arena when first drawn, so that a scene can be built and simulated without an OpenGL context.
+  // Kept afterwards to find duplicates of new meshes.
+  std::vector<BodyEdit::Vertex> vertices;
+  int coarser = -1; // index in Scene::meshes of the next level of detail, -1 if this is the coarsest
+  float radius = 0; // of bounding sphere around the origin of mesh space
+  bool uploaded = false;
+  GL::MeshArena::Range range; // in the arena
+  // Dequantization of the uploaded PackedVertex positions.
+  fvec3 pos_offset;
+  fvec3 pos_scale;
+
+  // Bodies drawn with this mesh in the current frame, set by Render(): their MeshInstances
+  // are at [first_instance, first_instance + instance_count) in the instance stream buffer.
+  size_t instance_count = 0;
+  size_t first_instance = 0;
 };
 
 class Body {
@@ -66,11 +115,62 @@ class Body {
   std::list<std::pair<dvec3, dvec3>> forces;
 
   // How to render it.
-  Mesh mesh;
+  int mesh = -1; // index in Scene::meshes of the finest level of detail, -1 for invisible
+  fvec3 tint = fvec3(0, 0, 0);
 
   Body(int idx): idx(idx) {}
 };
 
+// The part of body's state that is integrated over time. Templated for Scene::StepJacobian(),
+// which integrates it in dual numbers.
+template<typename T>
+struct TBodyState {
+  tvec3<T> pos;
+  tquat<T> rot;
+  tvec3<T> momentum;
+  tvec3<T> ang;
+
+  // Number of scalar components, in the order above.
+  static const int kComponents = 13;
+
+  TBodyState() = default;
+
+  // Component k < kComponents, in the order above.
+  T& Component(int k) {
+    T* c[kComponents] = {
+      &pos.x, &pos.y, &pos.z, &rot.a, &rot.b, &rot.c, &rot.d,
+      &momentum.x, &momentum.y, &momentum.z, &ang.x, &ang.y, &ang.z};
+    return *c[k];
+  }
+
+  void FromBody(const Body& b) {
+    pos = b.pos; rot = b.rot; momentum = b.momentum; ang = b.ang;
+  }
+  void ToBody(Body& b) {
+    b.pos = pos; b.rot = rot; b.momentum = momentum; b.ang = ang;
+  }
+
+  static TBodyState Zero() {
+    TBodyState s;
+    s.pos = s.momentum = s.ang = tvec3<T>(0, 0, 0);
+    s.rot = tquat<T>(1, 0, 0, 0);
+    return s;
+  }
+};
+
+using BodyState = TBodyState<double>;
+
+// Receives the state of all bodies after every physics substep, see Scene::trajectory_sink.
+// Called on the thread that calls Scene::PhysicsStep(), so it should be fast.
+class TrajectorySink {
+ public:
+  virtual ~TrajectorySink() {}
+
+  // `time` is simulation time (Scene::time) at the end of the substep.
+  // `states` are indexed by body idx. Rotations are not normalized.
+  virtual void OnSubstep(double time, size_t count, const BodyState* states) = 0;
+};
+
 // A generic constraint, similar to e.g. btGeneric6DofConstraint in Bullet Physics.
 // It's probably better to use the bigger/more-stationary body as body1 and the more movable as body2.
 // (I don't know how much better yet. body2 is slightly moved in non-physical ways to compensate for numerical errors.)
@@ -122,6 +222,9 @@ class Scene {
 
   Body* AddBody();
   Body* AddBody(BodyEdit edit); // puts c.o.m. at origin
+  // Returns index in `meshes`. Reuses an existing mesh if it has exactly the same vertices
+  // and next level of detail (index in `meshes`, or -1).
+  int AddMesh(std::vector<BodyEdit::Vertex> vertices, int coarser = -1);
   // pos1 and rot1 are calculated from current positions and orientations of the two bodies.
   Constraint* AddConstraint(int body1, int body2, dvec3 pos2, dquat rot2, Constraint::dof_t lock);
 
@@ -132,12 +235,20 @@ class Scene {
 
   void Render();
   void PhysicsStep(double dt);
+  // Derivatives of the state of all bodies after PhysicsStep(dt) by their state before it, without
+  // changing the scene: jacobian[i][j] is that of component i by component j, both numbered
+  // body * BodyState::kComponents + component. Body::forces stay where they are in world space.
+  // Exact up to rounding: one run of the integrator in dual numbers (util/dual.h) per body, where
+  // finite differences would take two PhysicsStep()s per component.
+  void StepJacobian(double dt, DMatrix& jacobian) const;
 
   double GetEnergy() const;
 
   std::deque<Body> bodies;
   std::deque<Constraint> constraints;
+  std::deque<Mesh> meshes;
   dvec3 gravity = dvec3(0, 0, 0);
+  double time = 0; // simulation time, advanced by PhysicsStep()
 
   Camera camera;
   fvec3 light_vec = fvec3(-3, 2, 1).Normalized(); // direction from which the light is coming
@@ -153,8 +264,58 @@ class Scene {
   size_t force_resolution_success = 0;
   size_t force_resolution_failed = 0;
 
+  // From PhysicsStep(), not saved in snapshots.
+  size_t substeps = 0; // total
+  double solver_seconds = 0; // total wall time spent solving for constraint forces
+  size_t system_size = 0; // constraint equations (unknown forces) in the last step
+
+  // From the last Render(): one instanced draw command per mesh (level of detail) used by any body,
+  // all submitted with a single call (two if some mesh needs 32-bit indices) if multi-draw
+  // indirect is supported.
+  size_t draw_commands = 0;
+  size_t draw_calls = 0;
+  size_t drawn_triangles = 0;
+  size_t culled_bodies = 0; // outside of the view frustum
+
+  // Level of detail: a body uses its finest mesh while the radius of its bounding sphere
+  // on screen is at least this many pixels, and one level coarser per halving of that.
+  float lod_radius_pixels = 64;
+
+  // Optional profiling of the physics hot spots, see bench.cpp. Not owned.
+  struct PhysicsProfile {
+    PerfCounters runge_kutta;
+    PerfCounters resolve_forces;
+    PerfCounters solve_linear_system;
+  };
+  PhysicsProfile* profile = nullptr;
+
+  // Optional per-substep output of body states, e.g. TrajectoryWriter. Not owned.
+  TrajectorySink* trajectory_sink = nullptr;
+
+  // Optional cache of the linked shader program, used by the first Render(). Not owned.
+  GL::ProgramBinaryCache* program_cache = nullptr;
+
  private:
-  GL::Shader shader_;
+  // Created on the first Render().
+  std::unique_ptr<GL::Shader> shader_;
+  std::unique_ptr<GL::UniformBuffer> frame_uniforms_;
+  // Geometry of all uploaded meshes.
+  std::unique_ptr<GL::MeshArena> mesh_arena_;
+  // Draw commands followed by MeshInstances of all drawn bodies, written in place every frame.
+  std::unique_ptr<GL::StreamBuffer> instance_stream_;
+  // Those of meshes with 16-bit indices, then those with 32-bit ones (collected in wide_commands_).
+  std::vector<GL::MeshArena::DrawCommand> draw_commands_, wide_commands_;
+  // Bounding spheres of bodies with meshes, for frustum culling; reused between frames.
+  std::vector<float> cull_x_, cull_y_, cull_z_, cull_r_;
+  std::vector<const Body*> cull_bodies_;
+  // Rotations and model matrices of `cull_bodies_`.
+  std::vector<fquat> cull_rot_;
+  std::vector<fmat4> model_mats_;
+  std::vector<uint8_t> visible_;
+  // Mesh (level of detail) chosen for each of `cull_bodies_`, -1 if culled.
+  std::vector<int> draw_mesh_;
+  // Hash of vertices -> indices in `meshes`.
+  std::unordered_multimap<uint64_t, int> mesh_by_hash_;
 };
 
 // All of unit density. Use `MultiplyMass()` to set density afterwards.
@@ -0,0 +1,129 @@
+#include "sim/snapshot.h"
+#include "util/binary-io.h"
+using namespace std;
+
+static const char kMagic[8] = {'C', 'U', 'B', 'E', 'S', 'N', 'A', 'P'};
+static const uint32_t kVersion = 2;
+static const size_t kHeaderSize = sizeof(kMagic) + sizeof(uint32_t) + sizeof(uint64_t);
+
+static void WriteMat(BinaryWriter& w, const dmat3& m) {
+  for (int i = 0; i < 9; ++i)
+    w.Write(m.m[i]);
+}
+
+static dmat3 ReadMat(BinaryReader& r) {
+  dmat3 m;
+  for (int i = 0; i < 9; ++i)
+    m.m[i] = r.Read<double>();
+  return m;
+}
+
+SceneSnapshot::SceneSnapshot(const Scene& scene) {
+  BinaryWriter w;
+  w.WriteBytes(kMagic, sizeof(kMagic));
+  w.Write(kVersion);
+  w.Write<uint64_t>(0); // size, filled in below
+
+  w.Write(scene.gravity);
+  w.Write(scene.time);
+  w.Write(scene.leaked_translation);
+  w.Write(scene.leaked_rotation);
+  w.Write(scene.leaked_velocity);
+  w.Write(scene.leaked_angular_velocity);
+  w.Write<uint64_t>(scene.force_resolution_success);
+  w.Write<uint64_t>(scene.force_resolution_failed);
+
+  w.Write<uint32_t>(scene.bodies.size());
+  for (const Body& b: scene.bodies) {
+    w.Write(b.inv_mass);
+    WriteMat(w, b.inv_inertia);
+    w.Write(b.pos);
+    w.Write(b.rot);
+    w.Write(b.momentum);
+    w.Write(b.ang);
+    w.Write<uint32_t>(b.forces.size());
+    for (const auto& f: b.forces) {
+      w.Write(f.first);
+      w.Write(f.second);
+    }
+  }
+
+  w.Write<uint32_t>(scene.constraints.size());
+  for (const Constraint& c: scene.constraints) {
+    w.Write<int32_t>(c.body1);
+    w.Write<int32_t>(c.body2);
+    w.Write(c.pos1);
+    w.Write(c.pos2);
+    w.Write(c.rot1);
+    w.Write(c.rot2);
+    w.Write(c.lock);
+  }
+
+  buf_ = w.data();
+  uint64_t size = buf_.size();
+  memcpy(&buf_[sizeof(kMagic) + sizeof(uint32_t)], &size, sizeof(size));
+  data_ = buf_.data();
+  size_ = buf_.size();
+}
+
+SceneSnapshot::SceneSnapshot(const string& path): file_(new MappedFile(path)) {
+  data_ = file_->data();
+  size_ = file_->size();
+  if (size_ < kHeaderSize || memcmp(data_, kMagic, sizeof(kMagic)))
+    throw IOException(path + " is not a scene snapshot");
+  BinaryReader r(data_ + sizeof(kMagic), size_ - sizeof(kMagic));
+  if (r.Read<uint32_t>() != kVersion)
+    throw IOException(path + ": unsupported snapshot version");
+  if (r.Read<uint64_t>() != size_)
+    throw IOException(path + ": truncated snapshot");
+}
+
+void SceneSnapshot::Save(const string& path) const {
+  WriteFileAtomically(path, data_, size_);
+}
+
+void SceneSnapshot::Restore(Scene& scene) const {
+  BinaryReader r(data_ + kHeaderSize, size_ - kHeaderSize);
+
+  scene.gravity = r.ReadVec3();
+  scene.time = r.Read<double>();
+  scene.leaked_translation = r.Read<double>();
+  scene.leaked_rotation = r.Read<double>();
+  scene.leaked_velocity = r.Read<double>();
+  scene.leaked_angular_velocity = r.Read<double>();
+  scene.force_resolution_success = r.Read<uint64_t>();
+  scene.force_resolution_failed = r.Read<uint64_t>();
+
+  size_t nbodies = r.Read<uint32_t>();
+  while (scene.bodies.size() > nbodies)
+    scene.bodies.pop_back();
+  while (scene.bodies.size() < nbodies)
+    scene.AddBody();
+  for (Body& b: scene.bodies) {
+    b.inv_mass = r.Read<double>();
+    b.inv_inertia = ReadMat(r);
+    b.pos = r.ReadVec3();
+    b.rot = r.ReadQuat();
+    b.momentum = r.ReadVec3();
+    b.ang = r.ReadVec3();
+    b.forces.resize(r.Read<uint32_t>());
+    for (auto& f: b.forces) {
+      f.first = r.ReadVec3();
+      f.second = r.ReadVec3();
+    }
+  }
+
+  size_t nconstraints = r.Read<uint32_t>();
+  scene.constraints.resize(nconstraints);
+  for (Constraint& c: scene.constraints) {
+    c.body1 = r.Read<int32_t>();
+    c.body2 = r.Read<int32_t>();
+    c.pos1 = r.ReadVec3();
+    c.pos2 = r.ReadVec3();
+    c.rot1 = r.ReadQuat();
+    c.rot2 = r.ReadQuat();
+    c.lock = r.Read<Constraint::dof_t>();
+    if (c.body1 < -1 || c.body1 >= (int)nbodies || c.body2 < 0 || c.body2 >= (int)nbodies)
+      throw IOException("corrupted snapshot: constraint refers to a non-existent body");
+  }
+}
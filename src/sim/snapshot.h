@@ -0,0 +1,48 @@
+#pragma once
+#include "sim/scene.h"
+#include "util/mapped-file.h"
+#include <memory>
+#include <string>
+
+// Serialized physical state of a whole Scene: bodies (mass, inertia, state, forces),
+// constraints, gravity, simulation time and stats. Meshes, camera and light are not included.
+//
+// Use it to checkpoint long runs and resume them later, or to branch several
+// experiments from one warmed-up state:
+//   SceneSnapshot snap(scene);
+//   Scene fork;
+//   BuildSameScene(fork); // for meshes; optional
+//   snap.Restore(fork);
+//
+// Format: "CUBESNAP", uint32 version, uint64 total size, then scene, bodies and constraints.
+// All values in host byte order.
+class SceneSnapshot {
+ public:
+  // Captures the current state of `scene`.
+  explicit SceneSnapshot(const Scene& scene);
+  // Memory-maps a file written by Save(). Throws IOException if it's not a valid snapshot.
+  explicit SceneSnapshot(const std::string& path);
+
+  SceneSnapshot(const SceneSnapshot& rhs) = delete;
+  SceneSnapshot& operator=(const SceneSnapshot& rhs) = delete;
+
+  void Save(const std::string& path) const;
+
+  // Replaces bodies, constraints, gravity and stats of `scene`.
+  // Existing bodies keep their meshes; if the snapshot has more bodies than `scene`,
+  // the extra ones are added without meshes.
+  void Restore(Scene& scene) const;
+
+  const char* data() const {
+    return data_;
+  }
+  size_t size() const {
+    return size_;
+  }
+
+ private:
+  std::string buf_;
+  std::unique_ptr<MappedFile> file_;
+  const char* data_;
+  size_t size_;
+};
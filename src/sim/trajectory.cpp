@@ -0,0 +1,344 @@
+#include "sim/trajectory.h"
+#include "util/binary-io.h"
+#include "util/exceptions.h"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+using namespace std;
+
+static const char kMagic[8] = {'C', 'U', 'B', 'E', 'T', 'R', 'A', 'J'};
+static const char kIndexMagic[8] = {'C', 'U', 'B', 'E', 'T', 'I', 'D', 'X'};
+static const uint32_t kVersion = 1;
+static const size_t kComponents = BodyState::kComponents; // per body: pos xyz, rot abcd, momentum xyz, ang xyz
+
+static void ToComponents(const BodyState& s, double* c) {
+  c[0] = s.pos.x; c[1] = s.pos.y; c[2] = s.pos.z;
+  c[3] = s.rot.a; c[4] = s.rot.b; c[5] = s.rot.c; c[6] = s.rot.d;
+  c[7] = s.momentum.x; c[8] = s.momentum.y; c[9] = s.momentum.z;
+  c[10] = s.ang.x; c[11] = s.ang.y; c[12] = s.ang.z;
+}
+
+static BodyState FromComponents(const double* c) {
+  BodyState s;
+  s.pos = dvec3(c[0], c[1], c[2]);
+  s.rot = dquat(c[3], c[4], c[5], c[6]);
+  s.momentum = dvec3(c[7], c[8], c[9]);
+  s.ang = dvec3(c[10], c[11], c[12]);
+  return s;
+}
+
+static void ComponentSteps(const TrajectoryOptions& o, double* steps) {
+  for (size_t i = 0; i < kComponents; ++i)
+    steps[i] = i < 3 ? o.pos_step : i < 7 ? o.rot_step : i < 10 ? o.momentum_step : o.ang_step;
+}
+
+static void PutVarint(string& s, uint64_t v) {
+  while (v >= 0x80) {
+    s += (char)(v | 0x80);
+    v >>= 7;
+  }
+  s += (char)v;
+}
+
+static uint64_t GetVarint(BinaryReader& r) {
+  uint64_t v = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    uint8_t b = r.Read<uint8_t>();
+    v |= (uint64_t)(b & 0x7f) << shift;
+    if (!(b & 0x80))
+      return v;
+  }
+  throw IOException("corrupted trajectory: bad varint");
+}
+
+static void EncodeColumn(string& out, const double* v, size_t n, double step) {
+  if (step == 0) {
+    uint64_t prev = 0;
+    for (size_t i = 0; i < n; ++i) {
+      uint64_t bits;
+      memcpy(&bits, &v[i], sizeof(bits));
+      PutVarint(out, bits ^ prev);
+      prev = bits;
+    }
+  } else {
+    uint64_t prev = 0;
+    for (size_t i = 0; i < n; ++i) {
+      uint64_t q = (uint64_t)llround(v[i] / step);
+      uint64_t d = q - prev;
+      PutVarint(out, (d << 1) ^ (uint64_t)((int64_t)d >> 63)); // zigzag
+      prev = q;
+    }
+  }
+}
+
+static void DecodeColumn(BinaryReader& r, double* v, size_t n, double step) {
+  if (step == 0) {
+    uint64_t prev = 0;
+    for (size_t i = 0; i < n; ++i) {
+      prev ^= GetVarint(r);
+      memcpy(&v[i], &prev, sizeof(prev));
+    }
+  } else {
+    uint64_t prev = 0;
+    for (size_t i = 0; i < n; ++i) {
+      uint64_t z = GetVarint(r);
+      prev += (z >> 1) ^ -(z & 1);
+      v[i] = (int64_t)prev * step;
+    }
+  }
+}
+
+TrajectoryWriter::TrajectoryWriter(const string& path, size_t bodies, const TrajectoryOptions& options)
+    : path_(path), bodies_(bodies), options_(options), queue_(options.queue_samples) {
+  assert(options_.block_samples > 0);
+  file_ = fopen(path.c_str(), "wb");
+  if (!file_)
+    throw IOException("couldn't open " + path + " for writing");
+
+  BinaryWriter w;
+  w.WriteBytes(kMagic, sizeof(kMagic));
+  w.Write(kVersion);
+  w.Write<uint32_t>(bodies_);
+  w.Write<uint32_t>(options_.block_samples);
+  w.Write(options_.pos_step);
+  w.Write(options_.rot_step);
+  w.Write(options_.momentum_step);
+  w.Write(options_.ang_step);
+  Write(w.data().data(), w.size());
+
+  columns_.resize(bodies_ * kComponents * options_.block_samples);
+  times_.reserve(options_.block_samples);
+  thread_ = thread(&TrajectoryWriter::WriterThread, this);
+}
+
+TrajectoryWriter::~TrajectoryWriter() {
+  try {
+    Finish();
+  } catch (...) {
+    LogCurrentException();
+  }
+}
+
+void TrajectoryWriter::OnSubstep(double time, size_t count, const BodyState* states) {
+  assert(!finished_);
+  assert(count == bodies_);
+  Sample* s = queue_.BeginPush();
+  if (!s) {
+    ++stalls_;
+    while (!(s = queue_.BeginPush()))
+      this_thread::yield();
+  }
+  s->time = time;
+  s->states.assign(states, states + count);
+  queue_.EndPush();
+  ++samples_;
+}
+
+void TrajectoryWriter::Finish() {
+  if (finished_)
+    return;
+  finished_ = true;
+  done_.store(true, memory_order_release);
+  thread_.join();
+
+  BinaryWriter w;
+  for (const BlockInfo& b: index_) {
+    w.Write(b.offset);
+    w.Write(b.first_time);
+    w.Write(b.last_time);
+  }
+  w.Write(offset_);
+  w.Write<uint32_t>(index_.size());
+  w.WriteBytes(kIndexMagic, sizeof(kIndexMagic));
+  Write(w.data().data(), w.size());
+
+  if (fclose(file_))
+    failed_ = true;
+  if (failed_)
+    throw IOException("failed to write trajectory to " + path_);
+}
+
+void TrajectoryWriter::Write(const void* data, size_t size) {
+  if (fwrite(data, 1, size, file_) != size)
+    failed_ = true;
+  offset_ += size;
+}
+
+void TrajectoryWriter::WriterThread() {
+  const size_t block = options_.block_samples;
+  double c[kComponents];
+  while (true) {
+    Sample* s = queue_.Front();
+    if (!s) {
+      if (done_.load(memory_order_acquire) && queue_.Empty())
+        break;
+      this_thread::sleep_for(chrono::milliseconds(1));
+      continue;
+    }
+    size_t n = times_.size();
+    times_.push_back(s->time);
+    for (size_t b = 0; b < bodies_; ++b) {
+      ToComponents(s->states[b], c);
+      for (size_t k = 0; k < kComponents; ++k)
+        columns_[(b * kComponents + k) * block + n] = c[k];
+    }
+    queue_.Pop();
+    if (times_.size() == block)
+      FlushBlock();
+  }
+  FlushBlock();
+}
+
+void TrajectoryWriter::FlushBlock() {
+  size_t n = times_.size();
+  if (!n)
+    return;
+  const size_t block = options_.block_samples;
+  double steps[kComponents];
+  ComponentSteps(options_, steps);
+
+  encoded_.clear();
+  EncodeColumn(encoded_, times_.data(), n, 0);
+  for (size_t b = 0; b < bodies_; ++b) {
+    for (size_t k = 0; k < kComponents; ++k)
+      EncodeColumn(encoded_, &columns_[(b * kComponents + k) * block], n, steps[k]);
+  }
+
+  BlockInfo info = {offset_, times_.front(), times_.back()};
+  index_.push_back(info);
+  BinaryWriter w;
+  w.Write<uint32_t>(n);
+  w.Write<uint32_t>(encoded_.size());
+  w.Write(info.first_time);
+  w.Write(info.last_time);
+  Write(w.data().data(), w.size());
+  Write(encoded_.data(), encoded_.size());
+  times_.clear();
+}
+
+TrajectoryReader::TrajectoryReader(const string& path): file_(path) {
+  const size_t footer_size = sizeof(uint64_t) + sizeof(uint32_t) + sizeof(kIndexMagic);
+  BinaryReader r(file_.data(), file_.size());
+  if (file_.size() < sizeof(kMagic) + footer_size || memcmp(r.Skip(sizeof(kMagic)), kMagic, sizeof(kMagic)))
+    throw IOException(path + " is not a trajectory");
+  if (r.Read<uint32_t>() != kVersion)
+    throw IOException(path + ": unsupported trajectory version");
+  bodies_ = r.Read<uint32_t>();
+  options_.block_samples = r.Read<uint32_t>();
+  options_.pos_step = r.Read<double>();
+  options_.rot_step = r.Read<double>();
+  options_.momentum_step = r.Read<double>();
+  options_.ang_step = r.Read<double>();
+
+  BinaryReader footer(file_.data() + file_.size() - footer_size, footer_size);
+  uint64_t index_offset = footer.Read<uint64_t>();
+  size_t blocks = footer.Read<uint32_t>();
+  if (memcmp(footer.Skip(sizeof(kIndexMagic)), kIndexMagic, sizeof(kIndexMagic)))
+    throw IOException(path + ": trajectory has no index; was the writer finished?");
+  if (index_offset > file_.size() || !blocks)
+    throw IOException(path + ": empty or corrupted trajectory");
+  BinaryReader ir(file_.data() + index_offset, file_.size() - footer_size - index_offset);
+  index_.resize(blocks);
+  for (BlockInfo& b: index_) {
+    b.offset = ir.Read<uint64_t>();
+    b.first_time = ir.Read<double>();
+    b.last_time = ir.Read<double>();
+    if (b.offset >= index_offset)
+      throw IOException(path + ": corrupted trajectory index");
+  }
+}
+
+double TrajectoryReader::start_time() const {
+  return index_.front().first_time;
+}
+
+double TrajectoryReader::end_time() const {
+  return index_.back().last_time;
+}
+
+// Returns the last block starting at or before `time` (or 0).
+size_t TrajectoryReader::FindBlock(double time) const {
+  size_t n = index_.size();
+  double span = end_time() - start_time();
+  size_t i = span > 0 ? (size_t)max(0., min((double)n - 1, (time - start_time()) / span * n)) : 0;
+  while (i > 0 && index_[i].first_time > time)
+    --i;
+  while (i + 1 < n && index_[i + 1].first_time <= time)
+    ++i;
+  return i;
+}
+
+const TrajectoryReader::DecodedBlock& TrajectoryReader::Decode(size_t block) {
+  for (size_t i = 0; i < 2; ++i) {
+    if (cache_[i].idx == block) {
+      last_used_ = i;
+      return cache_[i];
+    }
+  }
+  last_used_ ^= 1;
+  DecodedBlock& d = cache_[last_used_];
+  d.idx = (size_t)-1; // in case decoding throws
+
+  const BlockInfo& info = index_[block];
+  BinaryReader r(file_.data() + info.offset, file_.size() - info.offset);
+  d.samples = r.Read<uint32_t>();
+  size_t bytes = r.Read<uint32_t>();
+  r.Skip(2 * sizeof(double)); // times, already in the index
+  BinaryReader payload(r.Skip(bytes), bytes);
+
+  double steps[kComponents];
+  ComponentSteps(options_, steps);
+  d.times.resize(d.samples);
+  d.columns.resize(bodies_ * kComponents * d.samples);
+  DecodeColumn(payload, d.times.data(), d.samples, 0);
+  for (size_t b = 0; b < bodies_; ++b) {
+    for (size_t k = 0; k < kComponents; ++k)
+      DecodeColumn(payload, &d.columns[(b * kComponents + k) * d.samples], d.samples, steps[k]);
+  }
+  d.idx = block;
+  return d;
+}
+
+void TrajectoryReader::GetState(const DecodedBlock& b, size_t sample, size_t body, double* c) const {
+  for (size_t k = 0; k < kComponents; ++k)
+    c[k] = b.columns[(body * kComponents + k) * b.samples + sample];
+}
+
+void TrajectoryReader::StatesAt(double time, BodyState* states) {
+  time = max(start_time(), min(end_time(), time));
+  size_t block = FindBlock(time);
+  const DecodedBlock* b0 = &Decode(block);
+  // Last sample at or before `time`.
+  size_t i0 = upper_bound(b0->times.begin(), b0->times.end(), time) - b0->times.begin();
+  i0 = i0 ? i0 - 1 : 0;
+  // The next sample may be in the next block.
+  const DecodedBlock* b1 = b0;
+  size_t i1 = i0 + 1;
+  if (i1 == b0->samples) {
+    if (block + 1 < index_.size()) {
+      b1 = &Decode(block + 1);
+      b0 = &Decode(block); // still cached
+      i1 = 0;
+    } else {
+      i1 = i0;
+    }
+  }
+  double t0 = b0->times[i0];
+  double t1 = b1->times[i1];
+  double f = t1 > t0 ? (time - t0) / (t1 - t0) : 0;
+
+  double c0[kComponents], c1[kComponents], c[kComponents];
+  for (size_t body = 0; body < bodies_; ++body) {
+    GetState(*b0, i0, body, c0);
+    GetState(*b1, i1, body, c1);
+    // Take the shorter way between the two rotations.
+    double dot = c0[3]*c1[3] + c0[4]*c1[4] + c0[5]*c1[5] + c0[6]*c1[6];
+    for (size_t k = 0; k < kComponents; ++k) {
+      double v1 = k >= 3 && k < 7 && dot < 0 ? -c1[k] : c1[k];
+      c[k] = c0[k] + (v1 - c0[k]) * f;
+    }
+    states[body] = FromComponents(c);
+    states[body].rot.NormalizeMe();
+  }
+}
@@ -0,0 +1,139 @@
+#pragma once
+#include "sim/scene.h"
+#include "util/mapped-file.h"
+#include "util/spsc-queue.h"
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Trajectory file: states of all bodies at every physics substep.
+//
+// Layout (host byte order):
+//   header: "CUBETRAJ", uint32 version, uint32 bodies, uint32 samples per block,
+//           double quantization steps for pos, rot, momentum, ang (0 = stored exactly);
+//   blocks: uint32 samples, uint32 payload bytes, double first time, double last time, payload;
+//   index:  for each block uint64 offset, double first time, double last time;
+//   footer: uint64 index offset, uint32 blocks, "CUBETIDX".
+//
+// Block payload is columnar: the time column, then for each body 13 columns
+// (pos xyz, rot abcd, momentum xyz, ang xyz), each with one value per sample.
+// Within a column each value is delta-coded against the previous one and written as a varint:
+// quantized values as zigzag-coded integer differences, exact values as XOR of the bit patterns.
+// Every block starts from zero, so blocks can be decoded independently.
+struct TrajectoryOptions {
+  size_t block_samples = 256;
+  // How many substeps can be waiting to be encoded before OnSubstep() has to wait for the writer thread.
+  size_t queue_samples = 1024;
+  // Quantization steps, 0 means lossless.
+  double pos_step = 0;
+  double rot_step = 0;
+  double momentum_step = 0;
+  double ang_step = 0;
+};
+
+// Streams trajectory to a file. OnSubstep() only copies the states into a lock-free queue;
+// encoding and writing happen on a separate thread.
+// Usage: scene.trajectory_sink = &writer;
+class TrajectoryWriter: public TrajectorySink {
+ public:
+  TrajectoryWriter(const std::string& path, size_t bodies, const TrajectoryOptions& options = TrajectoryOptions());
+  // Calls Finish() if it wasn't called.
+  ~TrajectoryWriter();
+
+  TrajectoryWriter(const TrajectoryWriter& rhs) = delete;
+  TrajectoryWriter& operator=(const TrajectoryWriter& rhs) = delete;
+
+  void OnSubstep(double time, size_t count, const BodyState* states) override;
+
+  // Writes everything that's still queued, the block index and closes the file.
+  // Throws IOException if anything failed to write.
+  void Finish();
+
+  // Number of times OnSubstep() had to wait because the queue was full.
+  size_t stalls() const {
+    return stalls_;
+  }
+  size_t samples() const {
+    return samples_;
+  }
+
+ private:
+  struct Sample {
+    double time;
+    std::vector<BodyState> states;
+  };
+  struct BlockInfo {
+    uint64_t offset;
+    double first_time;
+    double last_time;
+  };
+
+  std::string path_;
+  size_t bodies_;
+  TrajectoryOptions options_;
+  FILE* file_;
+  SpscQueue<Sample> queue_;
+  std::atomic<bool> done_{false};
+  std::atomic<bool> failed_{false};
+  std::thread thread_;
+  bool finished_ = false;
+  size_t stalls_ = 0;
+  size_t samples_ = 0;
+
+  // Writer thread state.
+  std::vector<double> columns_; // [column * block_samples + sample]
+  std::vector<double> times_;
+  std::string encoded_;
+  std::vector<BlockInfo> index_;
+  uint64_t offset_ = 0;
+
+  void WriterThread();
+  void FlushBlock();
+  void Write(const void* data, size_t size);
+};
+
+// Reads a trajectory file via mmap, for playback without running physics.
+// Throws IOException if the file is not a complete trajectory.
+class TrajectoryReader {
+ public:
+  explicit TrajectoryReader(const std::string& path);
+
+  size_t bodies() const {
+    return bodies_;
+  }
+  double start_time() const;
+  double end_time() const;
+
+  // Fills `states` (bodies() elements) with states at `time`, linearly interpolated between
+  // the two nearest samples (rotations are normalized). `time` is clamped to the recorded range.
+  // Finds the block through the index, guessing its position from time, so seeking
+  // anywhere is O(1) for evenly spaced samples. Only the one or two needed blocks are decoded;
+  // the last two decoded blocks are cached, so playing forward or backward is cheap.
+  void StatesAt(double time, BodyState* states);
+
+ private:
+  struct BlockInfo {
+    uint64_t offset;
+    double first_time;
+    double last_time;
+  };
+  struct DecodedBlock {
+    size_t idx = (size_t)-1;
+    size_t samples = 0;
+    std::vector<double> times;
+    std::vector<double> columns; // [column * samples + sample]
+  };
+
+  MappedFile file_;
+  size_t bodies_;
+  TrajectoryOptions options_;
+  std::vector<BlockInfo> index_;
+  DecodedBlock cache_[2];
+  size_t last_used_ = 0;
+
+  size_t FindBlock(double time) const;
+  const DecodedBlock& Decode(size_t block);
+  void GetState(const DecodedBlock& b, size_t sample, size_t body, double* c) const;
+};
@@ -0,0 +1,85 @@
+#pragma once
+#include "vec.h"
+#include "quat.h"
+#include "exceptions.h"
+#include <string>
+#include <cstring>
+#include <type_traits>
+
+// Helpers for compact binary files. Values are stored in host byte order,
+// vectors and quaternions component by component (independent of struct layout).
+
+class BinaryWriter {
+ public:
+  template<typename T>
+  void Write(const T& v) {
+    static_assert(std::is_arithmetic<T>::value, "only plain numbers");
+    buf_.append(reinterpret_cast<const char*>(&v), sizeof(v));
+  }
+  void Write(const dvec3& v) {
+    Write(v.x); Write(v.y); Write(v.z);
+  }
+  void Write(const dquat& q) {
+    Write(q.a); Write(q.b); Write(q.c); Write(q.d);
+  }
+  void WriteBytes(const void* p, size_t n) {
+    buf_.append(static_cast<const char*>(p), n);
+  }
+
+  const std::string& data() const {
+    return buf_;
+  }
+  size_t size() const {
+    return buf_.size();
+  }
+  void Clear() {
+    buf_.clear();
+  }
+
+ private:
+  std::string buf_;
+};
+
+// Doesn't own the data. Throws IOException if reading past the end.
+class BinaryReader {
+ public:
+  BinaryReader(const void* data, size_t size)
+    : p_(static_cast<const char*>(data)), end_(p_ + size) {}
+
+  template<typename T>
+  T Read() {
+    static_assert(std::is_arithmetic<T>::value, "only plain numbers");
+    T v;
+    memcpy(&v, Skip(sizeof(v)), sizeof(v));
+    return v;
+  }
+  dvec3 ReadVec3() {
+    dvec3 v;
+    v.x = Read<double>(); v.y = Read<double>(); v.z = Read<double>();
+    return v;
+  }
+  dquat ReadQuat() {
+    dquat q;
+    q.a = Read<double>(); q.b = Read<double>(); q.c = Read<double>(); q.d = Read<double>();
+    return q;
+  }
+  // Returns pointer to the skipped bytes.
+  const char* Skip(size_t n) {
+    if ((size_t)(end_ - p_) < n)
+      throw IOException("unexpected end of binary data");
+    const char* r = p_;
+    p_ += n;
+    return r;
+  }
+
+  bool AtEnd() const {
+    return p_ == end_;
+  }
+  size_t Remaining() const {
+    return end_ - p_;
+  }
+
+ private:
+  const char* p_;
+  const char* end_;
+};
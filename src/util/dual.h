@@ -0,0 +1,209 @@
+#pragma once
+// Dual numbers for forward-mode automatic differentiation: a value and its derivatives along N
+// directions at once (vector mode). Every operation applies the chain rule, so code templated on
+// its scalar type (tvec3, tquat, tmat3, TMatrix, the integrator in sim/phys.cpp) run on
+// tdual<double, N> also computes the derivatives of its results with respect to the inputs that
+// were seeded with Variable(), exact up to rounding.
+//
+// Comparisons look at values only, so branches (e.g. pivoting in TMatrix::SolveLinearSystem()) are
+// differentiated along the branch taken.
+#include <cmath>
+#include <limits>
+#include <ostream>
+
+template<typename T, int N>
+struct tdual {
+  T v; // value
+  T d[N]; // derivatives along each direction
+
+  tdual() {}
+  tdual(T v): v(v) {
+    for (int i = 0; i < N; ++i)
+      d[i] = 0;
+  }
+
+  // Input number `i` of the N being differentiated by, with value v.
+  static tdual Variable(T v, int i) {
+    tdual r(v);
+    r.d[i] = 1;
+    return r;
+  }
+
+  tdual operator-() const {
+    tdual r;
+    r.v = -v;
+    for (int i = 0; i < N; ++i)
+      r.d[i] = -d[i];
+    return r;
+  }
+
+  tdual& operator+=(const tdual& b) {
+    v += b.v;
+    for (int i = 0; i < N; ++i)
+      d[i] += b.d[i];
+    return *this;
+  }
+  tdual& operator-=(const tdual& b) {
+    v -= b.v;
+    for (int i = 0; i < N; ++i)
+      d[i] -= b.d[i];
+    return *this;
+  }
+  tdual& operator*=(const tdual& b) {
+    for (int i = 0; i < N; ++i)
+      d[i] = d[i] * b.v + v * b.d[i];
+    v *= b.v;
+    return *this;
+  }
+  tdual& operator/=(const tdual& b) {
+    T inv = 1 / b.v;
+    v *= inv;
+    for (int i = 0; i < N; ++i)
+      d[i] = (d[i] - v * b.d[i]) * inv;
+    return *this;
+  }
+  tdual& operator+=(T b) {
+    v += b;
+    return *this;
+  }
+  tdual& operator-=(T b) {
+    v -= b;
+    return *this;
+  }
+  tdual& operator*=(T b) {
+    v *= b;
+    for (int i = 0; i < N; ++i)
+      d[i] *= b;
+    return *this;
+  }
+  tdual& operator/=(T b) {
+    v /= b;
+    for (int i = 0; i < N; ++i)
+      d[i] /= b;
+    return *this;
+  }
+
+  // Found by argument-dependent lookup; plain scalars convert to tdual where there's no overload
+  // for them. Results are built in place rather than as a modified copy of an operand, which
+  // costs a copy of the derivatives per operation.
+  friend tdual operator+(const tdual& a, const tdual& b) {
+    tdual r;
+    r.v = a.v + b.v;
+    for (int i = 0; i < N; ++i)
+      r.d[i] = a.d[i] + b.d[i];
+    return r;
+  }
+  friend tdual operator-(const tdual& a, const tdual& b) {
+    tdual r;
+    r.v = a.v - b.v;
+    for (int i = 0; i < N; ++i)
+      r.d[i] = a.d[i] - b.d[i];
+    return r;
+  }
+  friend tdual operator*(const tdual& a, const tdual& b) {
+    tdual r;
+    r.v = a.v * b.v;
+    for (int i = 0; i < N; ++i)
+      r.d[i] = a.d[i] * b.v + a.v * b.d[i];
+    return r;
+  }
+  friend tdual operator/(const tdual& a, const tdual& b) {
+    tdual r;
+    T inv = 1 / b.v;
+    r.v = a.v * inv;
+    for (int i = 0; i < N; ++i)
+      r.d[i] = (a.d[i] - r.v * b.d[i]) * inv;
+    return r;
+  }
+  friend tdual operator+(const tdual& a, T b) {
+    tdual r = a;
+    r.v += b;
+    return r;
+  }
+  friend tdual operator-(const tdual& a, T b) {
+    tdual r = a;
+    r.v -= b;
+    return r;
+  }
+  friend tdual operator*(const tdual& a, T b) {
+    tdual r;
+    r.v = a.v * b;
+    for (int i = 0; i < N; ++i)
+      r.d[i] = a.d[i] * b;
+    return r;
+  }
+  friend tdual operator/(const tdual& a, T b) {
+    tdual r;
+    r.v = a.v / b;
+    for (int i = 0; i < N; ++i)
+      r.d[i] = a.d[i] / b;
+    return r;
+  }
+  friend tdual operator+(T a, const tdual& b) { return b + a; }
+  friend tdual operator-(T a, const tdual& b) {
+    tdual r;
+    r.v = a - b.v;
+    for (int i = 0; i < N; ++i)
+      r.d[i] = -b.d[i];
+    return r;
+  }
+  friend tdual operator*(T a, const tdual& b) { return b * a; }
+  friend tdual operator/(T a, const tdual& b) {
+    tdual r;
+    r.v = a / b.v;
+    T c = -r.v / b.v;
+    for (int i = 0; i < N; ++i)
+      r.d[i] = b.d[i] * c;
+    return r;
+  }
+
+  friend bool operator==(const tdual& a, const tdual& b) { return a.v == b.v; }
+  friend bool operator!=(const tdual& a, const tdual& b) { return a.v != b.v; }
+  friend bool operator<(const tdual& a, const tdual& b) { return a.v < b.v; }
+  friend bool operator>(const tdual& a, const tdual& b) { return a.v > b.v; }
+  friend bool operator<=(const tdual& a, const tdual& b) { return a.v <= b.v; }
+  friend bool operator>=(const tdual& a, const tdual& b) { return a.v >= b.v; }
+
+  friend tdual sqrt(const tdual& a) {
+    tdual r;
+    r.v = std::sqrt(a.v);
+    T c = .5 / r.v;
+    for (int i = 0; i < N; ++i)
+      r.d[i] = a.d[i] * c;
+    return r;
+  }
+  // The derivative at 0 is taken from the positive side.
+  friend tdual abs(const tdual& a) {
+    return a.v < 0 ? -a : a;
+  }
+  friend tdual sin(const tdual& a) {
+    tdual r;
+    r.v = std::sin(a.v);
+    T c = std::cos(a.v);
+    for (int i = 0; i < N; ++i)
+      r.d[i] = a.d[i] * c;
+    return r;
+  }
+  friend tdual cos(const tdual& a) {
+    tdual r;
+    r.v = std::cos(a.v);
+    T c = -std::sin(a.v);
+    for (int i = 0; i < N; ++i)
+      r.d[i] = a.d[i] * c;
+    return r;
+  }
+};
+
+template<typename T, int N>
+std::ostream& operator<<(std::ostream& o, const tdual<T, N>& a) {
+  o << a.v << "[";
+  for (int i = 0; i < N; ++i)
+    o << (i ? "," : "") << a.d[i];
+  return o << "]";
+}
+
+// Same limits as the value type, e.g. for TMatrix::SolveLinearSystem()'s default epsilon.
+namespace std {
+template<typename T, int N>
+class numeric_limits<tdual<T, N>> : public numeric_limits<T> {};
+}
@@ -0,0 +1,61 @@
+#include "util/frame-pacer.h"
+#include <algorithm>
+#include <thread>
+using namespace std;
+
+// Left between the predicted end of rendering and the present, for scheduling jitter.
+static const double kMarginSeconds = .002;
+// Weight of a new sample in the smoothed render time.
+static const double kRenderWeight = .1;
+
+const int FramePacer::kPeriodWindow;
+
+static FramePacer::clock::duration Seconds(double s) {
+  return chrono::duration_cast<FramePacer::clock::duration>(chrono::duration<double>(s));
+}
+
+FramePacer::FramePacer(double fps_cap, bool late_input)
+  : fps_cap_(fps_cap), late_input_(late_input) {}
+
+FramePacer::clock::time_point FramePacer::next_present() const {
+  return last_present_ + Seconds(present_period_);
+}
+
+void FramePacer::WaitForFrameStart() {
+  clock::time_point now = clock::now();
+  if (last_present_ != clock::time_point()) {
+    clock::time_point start = now;
+    if (fps_cap_ > 0)
+      start = frame_start_ + Seconds(1 / fps_cap_);
+    if (late_input_)
+      start = max(start, next_present() - Seconds(render_seconds_ + kMarginSeconds));
+    if (start > now)
+      this_thread::sleep_until(start);
+  }
+  frame_start_ = clock::now();
+}
+
+void FramePacer::FrameRendered() {
+  // Rise at once so that a slow frame doesn't make the next ones late too, decay slowly.
+  double render = chrono::duration<double>(clock::now() - frame_start_).count();
+  if (render > render_seconds_)
+    render_seconds_ = render;
+  else
+    render_seconds_ += (render - render_seconds_) * kRenderWeight;
+}
+
+void FramePacer::FramePresented() {
+  clock::time_point now = clock::now();
+  if (last_present_ != clock::time_point()) {
+    double period = chrono::duration<double>(now - last_present_).count();
+    // A windowed minimum: waking up early only costs latency, but overestimating the period
+    // makes the loop miss a vsync, which makes the next period longer still, so missed vsyncs
+    // mustn't count. Still the window forgets short periods (a swap that returned early, the
+    // old rate after a monitor change) once they're over.
+    periods_[next_period_] = period;
+    next_period_ = (next_period_ + 1) % kPeriodWindow;
+    period_count_ = min(period_count_ + 1, kPeriodWindow);
+    present_period_ = *min_element(periods_, periods_ + period_count_);
+  }
+  last_present_ = now;
+}
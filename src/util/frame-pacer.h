@@ -0,0 +1,56 @@
+#pragma once
+#include <chrono>
+
+// Decides when the main loop starts each frame:
+//   FramePacer pacer(fps_cap, late_input);
+//   while (...) {
+//     pacer.WaitForFrameStart();
+//     glfwPollEvents(); // sample input
+//     ...simulate, render...
+//     pacer.FrameRendered();
+//     window.SwapBuffers();
+//     pacer.FramePresented();
+//   }
+//
+// With a frame cap, frames start at most `fps_cap` times per second. With late input, the loop
+// also sleeps until just before the next frame is due: the predicted next present (from the
+// measured present period) minus the recent render time and a safety margin. That only helps
+// when SwapBuffers() waits for vsync; otherwise frames are shown as soon as they're rendered.
+class FramePacer {
+ public:
+  typedef std::chrono::steady_clock clock;
+
+  // `fps_cap` <= 0 means no cap.
+  FramePacer(double fps_cap, bool late_input);
+
+  // Sleeps until the frame should start.
+  void WaitForFrameStart();
+  // Call right before SwapBuffers(), which may wait for vsync.
+  void FrameRendered();
+  // Call right after SwapBuffers() returns.
+  void FramePresented();
+
+  // Smoothed time from WaitForFrameStart() returning to FrameRendered().
+  double render_seconds() const {
+    return render_seconds_;
+  }
+  // Estimated time between presents, on the low side: the shortest of the last kPeriodWindow.
+  double present_period() const {
+    return present_period_;
+  }
+  // Predicted time of the next present, for extrapolating what's drawn to when it's seen.
+  clock::time_point next_present() const;
+
+ private:
+  double fps_cap_;
+  bool late_input_;
+  double render_seconds_ = 0;
+  double present_period_ = 0;
+  // Presents whose periods the estimate is taken over, about a second at 60-144 Hz.
+  static const int kPeriodWindow = 120;
+  double periods_[kPeriodWindow]; // ring buffer
+  int next_period_ = 0;
+  int period_count_ = 0;
+  clock::time_point frame_start_;
+  clock::time_point last_present_;
+};
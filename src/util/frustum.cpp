@@ -0,0 +1,61 @@
+#include "util/frustum.h"
+#include <cmath>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+Frustum::Frustum(const fmat4& view_proj) {
+  // Clip space point p is inside if -w <= x, y, z <= w, i.e. for each row r of x, y, z
+  // (w_row + r) * p >= 0 and (w_row - r) * p >= 0.
+  const float* m = view_proj.m;
+  for (int row = 0; row < 3; ++row) {
+    for (int sign = -1; sign <= 1; sign += 2) {
+      Plane p;
+      p.a = m[12] + sign * m[row * 4 + 0];
+      p.b = m[13] + sign * m[row * 4 + 1];
+      p.c = m[14] + sign * m[row * 4 + 2];
+      p.d = m[15] + sign * m[row * 4 + 3];
+      float len = sqrt(p.a * p.a + p.b * p.b + p.c * p.c);
+      if (len < 1e-6f)
+        continue;
+      p.a /= len;
+      p.b /= len;
+      p.c /= len;
+      p.d /= len;
+      planes_[count_++] = p;
+    }
+  }
+}
+
+void Frustum::CullSpheres(size_t n, const float* x, const float* y, const float* z, const float* r, uint8_t* visible) const {
+  size_t i = 0;
+#ifdef __SSE2__
+  for (; i + 4 <= n; i += 4) {
+    __m128 px = _mm_loadu_ps(x + i);
+    __m128 py = _mm_loadu_ps(y + i);
+    __m128 pz = _mm_loadu_ps(z + i);
+    __m128 neg_r = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(r + i));
+    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (int k = 0; k < count_; ++k) {
+      const Plane& p = planes_[k];
+      __m128 dist = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(p.a)), _mm_mul_ps(py, _mm_set1_ps(p.b))),
+        _mm_add_ps(_mm_mul_ps(pz, _mm_set1_ps(p.c)), _mm_set1_ps(p.d)));
+      inside = _mm_and_ps(inside, _mm_cmpge_ps(dist, neg_r));
+    }
+    int mask = _mm_movemask_ps(inside);
+    visible[i + 0] = mask & 1;
+    visible[i + 1] = (mask >> 1) & 1;
+    visible[i + 2] = (mask >> 2) & 1;
+    visible[i + 3] = (mask >> 3) & 1;
+  }
+#endif
+  for (; i < n; ++i) {
+    bool inside = true;
+    for (int k = 0; k < count_; ++k) {
+      const Plane& p = planes_[k];
+      inside &= p.a * x[i] + p.b * y[i] + p.c * z[i] + p.d >= -r[i];
+    }
+    visible[i] = inside;
+  }
+}
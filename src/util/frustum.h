@@ -0,0 +1,24 @@
+#pragma once
+#include "util/mat.h"
+#include <cstddef>
+#include <cstdint>
+
+// View frustum as six planes extracted from a view-projection matrix (Gribb & Hartmann).
+// Planes that degenerate, like the far plane of an infinite projection, are dropped.
+class Frustum {
+ public:
+  explicit Frustum(const fmat4& view_proj);
+
+  // Tests n bounding spheres given as separate arrays of center coordinates and radii.
+  // Sets visible[i] to 1 if sphere i may intersect the frustum, 0 if it's fully outside.
+  // Conservative near the frustum's edges and corners. Uses SSE2, 4 spheres per iteration, where available.
+  void CullSpheres(size_t n, const float* x, const float* y, const float* z, const float* r, uint8_t* visible) const;
+
+ private:
+  // Inside is where a*x + b*y + c*z + d >= 0; (a, b, c) is unit.
+  struct Plane {
+    float a, b, c, d;
+  };
+  Plane planes_[6];
+  int count_ = 0;
+};
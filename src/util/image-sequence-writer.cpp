@@ -0,0 +1,80 @@
+#include "util/image-sequence-writer.h"
+#include "util/exceptions.h"
+#include <chrono>
+#include <cstdio>
+using namespace std;
+
+ImageSequenceWriter::ImageSequenceWriter(const string& pattern, ivec2 size, size_t queue_frames)
+    : pattern_(pattern), size_(size), queue_(queue_frames) {
+  thread_ = thread(&ImageSequenceWriter::WriterThread, this);
+}
+
+ImageSequenceWriter::~ImageSequenceWriter() {
+  try {
+    Finish();
+  } catch (...) {
+    LogCurrentException();
+  }
+}
+
+void ImageSequenceWriter::Write(const uint8_t* rgba) {
+  Frame* f = queue_.BeginPush();
+  if (!f) {
+    ++stalls_;
+    while (!(f = queue_.BeginPush()))
+      this_thread::yield();
+  }
+  f->idx = frames_++;
+  f->rgba.assign(rgba, rgba + size_.x * size_.y * 4);
+  queue_.EndPush();
+}
+
+void ImageSequenceWriter::Finish() {
+  if (finished_)
+    return;
+  finished_ = true;
+  done_.store(true, memory_order_release);
+  thread_.join();
+  if (!failed_path_.empty())
+    throw IOException("failed to write " + failed_path_);
+}
+
+void ImageSequenceWriter::WriterThread() {
+  while (true) {
+    Frame* f = queue_.Front();
+    if (!f) {
+      if (done_.load(memory_order_acquire) && queue_.Empty())
+        break;
+      this_thread::sleep_for(chrono::milliseconds(1));
+      continue;
+    }
+    WriteFile(*f);
+    queue_.Pop();
+  }
+}
+
+void ImageSequenceWriter::WriteFile(const Frame& frame) {
+  vector<char> path(pattern_.size() + 32);
+  snprintf(path.data(), path.size(), pattern_.c_str(), (int)frame.idx);
+
+  // PPM is RGB, top to bottom.
+  rgb_.resize(size_.x * size_.y * 3);
+  uint8_t* out = rgb_.data();
+  for (int y = size_.y - 1; y >= 0; --y) {
+    const uint8_t* in = &frame.rgba[y * size_.x * 4];
+    for (int x = 0; x < size_.x; ++x, in += 4, out += 3) {
+      out[0] = in[0];
+      out[1] = in[1];
+      out[2] = in[2];
+    }
+  }
+
+  FILE* file = fopen(path.data(), "wb");
+  bool ok = file &&
+    fprintf(file, "P6\n%d %d\n255\n", size_.x, size_.y) > 0 &&
+    fwrite(rgb_.data(), 1, rgb_.size(), file) == rgb_.size();
+  if (file && fclose(file))
+    ok = false;
+  if (!ok && failed_path_.empty())
+    failed_path_ = path.data();
+}
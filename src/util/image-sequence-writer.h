@@ -0,0 +1,60 @@
+#pragma once
+#include "util/spsc-queue.h"
+#include "util/vec.h"
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Writes frames as numbered binary PPM files on a separate thread, so that encoding
+// and disk writes don't slow down rendering. Write() only copies the pixels into a queue.
+//   ImageSequenceWriter writer("frames/%05d.ppm", size);
+//   writer.Write(pixels); // frames/00000.ppm
+//   writer.Write(pixels); // frames/00001.ppm
+//   writer.Finish();
+class ImageSequenceWriter {
+ public:
+  // `pattern` is a printf format with one integer conversion for the frame number.
+  ImageSequenceWriter(const std::string& pattern, ivec2 size, size_t queue_frames = 8);
+  // Calls Finish() if it wasn't called.
+  ~ImageSequenceWriter();
+
+  ImageSequenceWriter(const ImageSequenceWriter& rhs) = delete;
+  ImageSequenceWriter& operator=(const ImageSequenceWriter& rhs) = delete;
+
+  // `rgba` is size.x * size.y RGBA pixels, rows bottom to top (as glReadPixels() returns them).
+  void Write(const uint8_t* rgba);
+
+  // Waits until everything is written. Throws IOException if any file failed to write.
+  void Finish();
+
+  size_t frames() const {
+    return frames_;
+  }
+  // Number of times Write() had to wait because the queue was full.
+  size_t stalls() const {
+    return stalls_;
+  }
+
+ private:
+  struct Frame {
+    size_t idx;
+    std::vector<uint8_t> rgba;
+  };
+
+  std::string pattern_;
+  ivec2 size_;
+  SpscQueue<Frame> queue_;
+  std::atomic<bool> done_{false};
+  std::thread thread_;
+  bool finished_ = false;
+  size_t frames_ = 0;
+  size_t stalls_ = 0;
+
+  // Writer thread state.
+  std::string failed_path_; // first file that failed to write
+  std::vector<uint8_t> rgb_;
+
+  void WriterThread();
+  void WriteFile(const Frame& frame);
+};
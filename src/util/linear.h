@@ -1,5 +1,6 @@
 #pragma once
 #include <cassert>
+#include <limits>
 #include <valarray>
 
 template<typename T>
@@ -71,12 +72,13 @@ std::ostream& operator<<(std::ostream& o, const TMatrix<T>& m) {
 template<typename T>
 bool TMatrix<T>::SolveLinearSystem(T epsilon) {
   assert(m == n+1);
+  using std::abs; // or the T's own, e.g. tdual's
   bool ok = true;
   for (size_t i = 0; i < n; ++i) {
-    T mx = std::abs(a[i*m + i]);
+    T mx = abs(a[i*m + i]);
     size_t k = i;
     for (size_t j = i + 1; j < n; ++j) {
-      T t = std::abs(a[j*m + i]);
+      T t = abs(a[j*m + i]);
       if (t > mx) {
         mx = t;
         k = j;
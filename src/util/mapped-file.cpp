@@ -0,0 +1,47 @@
+#include "mapped-file.h"
+#include "exceptions.h"
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string& path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd == -1)
+    throw IOException("couldn't open " + path);
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    close(fd);
+    throw IOException("couldn't stat " + path);
+  }
+  size_ = st.st_size;
+  if (size_) {
+    void* p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) {
+      close(fd);
+      throw IOException("couldn't mmap " + path);
+    }
+    data_ = static_cast<const char*>(p);
+  }
+  // The mapping stays valid after closing the descriptor.
+  close(fd);
+}
+
+MappedFile::~MappedFile() {
+  if (data_)
+    munmap(const_cast<char*>(data_), size_);
+}
+
+void WriteFileAtomically(const std::string& path, const void* data, size_t size) {
+  std::string tmp = path + ".tmp";
+  FILE* f = fopen(tmp.c_str(), "wb");
+  if (!f)
+    throw IOException("couldn't open " + tmp + " for writing");
+  bool ok = fwrite(data, 1, size, f) == size;
+  ok = !fclose(f) && ok;
+  if (!ok || rename(tmp.c_str(), path.c_str())) {
+    remove(tmp.c_str());
+    throw IOException("couldn't write " + path);
+  }
+}
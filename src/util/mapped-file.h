@@ -0,0 +1,28 @@
+#pragma once
+#include <string>
+#include <cstddef>
+
+// Read-only memory-mapped file. Throws IOException if the file can't be opened.
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string& path);
+  ~MappedFile();
+
+  MappedFile(const MappedFile& rhs) = delete;
+  MappedFile& operator=(const MappedFile& rhs) = delete;
+
+  const char* data() const {
+    return data_;
+  }
+  size_t size() const {
+    return size_;
+  }
+
+ private:
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+// Writes `size` bytes to `path` atomically: to a temporary file first, then renames it.
+// Throws IOException on failure.
+void WriteFileAtomically(const std::string& path, const void* data, size_t size);
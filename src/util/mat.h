@@ -1,5 +1,9 @@
 #pragma once
 #include "vec.h"
+#include <type_traits>
+
+template<typename T, typename E>
+struct tmat3_expr;
 
 template<typename T>
 struct tmat3 {
@@ -16,6 +20,12 @@ struct tmat3 {
     for (int i = 0; i < 9; ++i)
       m[i] = (T)v.m[i];
   }
+  // Evaluates a sum, difference, negation or scaling of matrices in one pass, see tmat3_expr.
+  template<typename E>
+  tmat3(const tmat3_expr<T, E> &e) {
+    for (int i = 0; i < 9; ++i)
+      m[i] = e[i];
+  }
 
   T* operator[](size_t i) {
     return m + i*3;
@@ -35,23 +45,11 @@ struct tmat3 {
                  m[6]*b.m[1] + m[7]*b.m[4] + m[8]*b.m[7],
                  m[6]*b.m[2] + m[7]*b.m[5] + m[8]*b.m[8]);
   }
-  tmat3 operator*(T b) const {
-    tmat3 r;
-    for (int i = 0; i < 9; ++i)
-      r.m[i] = m[i] * b;
-    return r;
-  }
   tmat3& operator*=(T b) {
     for (int i = 0; i < 9; ++i)
       m[i] *= b;
     return *this;
   }
-  tmat3 operator/(T b) const {
-    tmat3 r;
-    for (int i = 0; i < 9; ++i)
-      r.m[i] = m[i] / b;
-    return r;
-  }
   tmat3& operator/=(T b) {
     for (int i = 0; i < 9; ++i)
       m[i] /= b;
@@ -67,21 +65,17 @@ struct tmat3 {
       m[i] -= b.m[i];
     return *this;
   }
-  tmat3 operator+(const tmat3& b) const {
-    tmat3 r = *this;
-    r += b;
-    return r;
-  }
-  tmat3 operator-(const tmat3& b) const {
-    tmat3 r = *this;
-    r -= b;
-    return r;
+  template<typename E>
+  tmat3& operator+=(const tmat3_expr<T, E>& b) {
+    for (int i = 0; i < 9; ++i)
+      m[i] += b[i];
+    return *this;
   }
-  tmat3 operator-() const {
-    tmat3 r;
+  template<typename E>
+  tmat3& operator-=(const tmat3_expr<T, E>& b) {
     for (int i = 0; i < 9; ++i)
-      r.m[i] = -m[i];
-    return r;
+      m[i] -= b[i];
+    return *this;
   }
   tmat3 Inverse() const {
     T d = m[0]*m[4]*m[8]-m[0]*m[5]*m[7]-m[1]*m[3]*m[8]+m[1]*m[5]*m[6]+m[2]*m[3]*m[7]-m[2]*m[4]*m[6];
@@ -122,10 +116,6 @@ struct tmat3 {
   }
 };
 
-template<typename T>
-tmat3<T> operator*(T b, const tmat3<T>& m) {
-  return m*b;
-}
 template<typename T>
 tvec3<T> operator*(const tmat3<T>& m, const tvec3<T>& v) {
   return tvec3<T>(v.x*m.m[0] + v.y*m.m[1] + v.z*m.m[2],
@@ -133,6 +123,117 @@ tvec3<T> operator*(const tmat3<T>& m, const tvec3<T>& v) {
                   v.x*m.m[6] + v.y*m.m[7] + v.z*m.m[8]);
 }
 
+// Lazy element-wise matrix arithmetic: a + b, a - b, -a, a * s, s * a and a / s of tmat3s and of
+// such expressions make a tmat3_expr, which computes nothing until it's converted to tmat3. Then
+// each element is computed in one go, with the same operations in the same order as one operator at
+// a time, but without a 9-element temporary per operator (the compiler keeps those in memory, unlike
+// the three components of a tvec3). Products evaluate their operands first.
+// An expression refers to its operands, so don't keep one (auto e = a + b) past its statement.
+template<typename T, typename E>
+struct tmat3_expr {
+  E e;
+
+  T operator[](int i) const { return e[i]; }
+  tmat3<T> Eval() const { return *this; }
+};
+
+namespace mat3_expr {
+
+template<typename T>
+struct Ref {
+  const tmat3<T>& a;
+  T operator[](int i) const { return a.m[i]; }
+};
+template<typename T, typename A, typename B>
+struct Sum {
+  A a; B b;
+  T operator[](int i) const { return a[i] + b[i]; }
+};
+template<typename T, typename A, typename B>
+struct Difference {
+  A a; B b;
+  T operator[](int i) const { return a[i] - b[i]; }
+};
+template<typename T, typename A>
+struct Negation {
+  A a;
+  T operator[](int i) const { return -a[i]; }
+};
+template<typename T, typename A>
+struct Scale {
+  A a; T s;
+  T operator[](int i) const { return a[i] * s; }
+};
+template<typename T, typename A>
+struct Quotient {
+  A a; T s;
+  T operator[](int i) const { return a[i] / s; }
+};
+
+// Element type and expression node of a tmat3 or tmat3_expr operand; nothing for other types, so
+// that the operators below don't apply to them.
+template<typename X>
+struct Operand {};
+template<typename T>
+struct Operand<tmat3<T>> {
+  typedef T type;
+  typedef Ref<T> node;
+  static node Node(const tmat3<T>& m) { return {m}; }
+};
+template<typename T, typename E>
+struct Operand<tmat3_expr<T, E>> {
+  typedef T type;
+  typedef E node;
+  static const E& Node(const tmat3_expr<T, E>& x) { return x.e; }
+};
+
+} // namespace mat3_expr
+
+template<typename A, typename B, typename T = typename mat3_expr::Operand<A>::type>
+tmat3_expr<T, mat3_expr::Sum<T, typename mat3_expr::Operand<A>::node, typename mat3_expr::Operand<B>::node>>
+operator+(const A& a, const B& b) {
+  return {{mat3_expr::Operand<A>::Node(a), mat3_expr::Operand<B>::Node(b)}};
+}
+template<typename A, typename B, typename T = typename mat3_expr::Operand<A>::type>
+tmat3_expr<T, mat3_expr::Difference<T, typename mat3_expr::Operand<A>::node, typename mat3_expr::Operand<B>::node>>
+operator-(const A& a, const B& b) {
+  return {{mat3_expr::Operand<A>::Node(a), mat3_expr::Operand<B>::Node(b)}};
+}
+template<typename A, typename T = typename mat3_expr::Operand<A>::type>
+tmat3_expr<T, mat3_expr::Negation<T, typename mat3_expr::Operand<A>::node>>
+operator-(const A& a) {
+  return {{mat3_expr::Operand<A>::Node(a)}};
+}
+template<typename A, typename T = typename mat3_expr::Operand<A>::type>
+tmat3_expr<T, mat3_expr::Scale<T, typename mat3_expr::Operand<A>::node>>
+operator*(const A& a, typename mat3_expr::Operand<A>::type s) {
+  return {{mat3_expr::Operand<A>::Node(a), s}};
+}
+template<typename A, typename T = typename mat3_expr::Operand<A>::type>
+tmat3_expr<T, mat3_expr::Scale<T, typename mat3_expr::Operand<A>::node>>
+operator*(typename mat3_expr::Operand<A>::type s, const A& a) {
+  return {{mat3_expr::Operand<A>::Node(a), s}};
+}
+template<typename A, typename T = typename mat3_expr::Operand<A>::type>
+tmat3_expr<T, mat3_expr::Quotient<T, typename mat3_expr::Operand<A>::node>>
+operator/(const A& a, typename mat3_expr::Operand<A>::type s) {
+  return {{mat3_expr::Operand<A>::Node(a), s}};
+}
+
+// Products of expressions.
+template<typename T, typename E>
+tmat3<T> operator*(const tmat3_expr<T, E>& a, const tmat3<T>& b) {
+  return a.Eval() * b;
+}
+template<typename T, typename E1, typename E2>
+tmat3<T> operator*(const tmat3_expr<T, E1>& a, const tmat3_expr<T, E2>& b) {
+  return a.Eval() * b.Eval();
+}
+template<typename T, typename E>
+tvec3<T> operator*(const tmat3_expr<T, E>& a, const tvec3<T>& v) {
+  return a.Eval() * v;
+}
+
 template<typename T>
 std::ostream& operator<<(std::ostream& o, const tmat3<T>& m) {
   o << '(';
@@ -199,3 +300,12 @@ struct fmat4 {
 
 using fmat3 = tmat3<float>;
 using dmat3 = tmat3<double>;
+
+// dmat3 products stay scalar: optimized, the template is as fast as SIMD row broadcasts.
+#if defined(CUBE_SIMD) && defined(CUBE_SIMD_VEC3)
+inline dmat3 dvec3::Skew() const {
+  return dmat3(0, -z, y,
+               z, 0, -x,
+               -y, x, 0);
+}
+#endif
@@ -0,0 +1,123 @@
+#include "perf-counters.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+#include <utility>
+#endif
+
+#ifdef __linux__
+
+static int OpenEvent(uint32_t type, uint64_t config, int group_fd) {
+  perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.disabled = group_fd == -1; // the leader enables the whole group
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0));
+}
+
+PerfCounters::PerfCounters() {
+  const std::pair<uint32_t, uint64_t> events[EVENT_COUNT] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                         (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                         (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+  };
+  for (int i = 0; i < EVENT_COUNT; ++i) {
+    fds_[i] = OpenEvent(events[i].first, events[i].second, leader_);
+    slot_[i] = -1;
+    if (fds_[i] == -1)
+      continue;
+    if (leader_ == -1)
+      leader_ = fds_[i];
+    slot_[i] = opened_++;
+  }
+  if (leader_ != -1) {
+    ioctl(leader_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(leader_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  }
+}
+
+PerfCounters::~PerfCounters() {
+  for (int i = 0; i < EVENT_COUNT; ++i) {
+    if (fds_[i] != -1)
+      close(fds_[i]);
+  }
+}
+
+bool PerfCounters::Read(Reading& r) const {
+  if (leader_ == -1)
+    return false;
+  uint64_t buf[3 + EVENT_COUNT];
+  ssize_t want = (3 + opened_) * sizeof(uint64_t);
+  if (read(leader_, buf, want) != want)
+    return false;
+  r.enabled = buf[1];
+  r.running = buf[2];
+  for (int i = 0; i < opened_; ++i)
+    r.values[i] = buf[3 + i];
+  return true;
+}
+
+#else
+
+PerfCounters::PerfCounters() {
+  for (int i = 0; i < EVENT_COUNT; ++i) {
+    fds_[i] = -1;
+    slot_[i] = -1;
+  }
+}
+
+PerfCounters::~PerfCounters() {}
+
+bool PerfCounters::Read(Reading& r) const {
+  return false;
+}
+
+#endif
+
+void PerfCounters::Start() {
+  Read(start_);
+  stopwatch_.Restart();
+}
+
+void PerfCounters::Stop() {
+  totals_.seconds += stopwatch_.TimeSinceRestart();
+  ++totals_.calls;
+  Reading end;
+  if (!Read(end))
+    return;
+  uint64_t running = end.running - start_.running;
+  // Extrapolate if the group was multiplexed with other groups.
+  double scale = running ? (double)(end.enabled - start_.enabled) / running : 0;
+  for (int i = 0; i < EVENT_COUNT; ++i) {
+    if (slot_[i] != -1)
+      totals_.events[i] += (end.values[slot_[i]] - start_.values[slot_[i]]) * scale;
+  }
+}
+
+void PerfCounters::Reset() {
+  totals_ = Totals();
+}
+
+const char* PerfCounters::EventName(Event e) {
+  switch (e) {
+    case CYCLES: return "cycles";
+    case INSTRUCTIONS: return "instructions";
+    case L1D_MISSES: return "L1d misses";
+    case LLC_MISSES: return "LLC misses";
+    case BRANCH_MISSES: return "branch misses";
+    default: return "?";
+  }
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include "stopwatch.h"
+#include <cstdint>
+#include <cstddef>
+
+// Hardware performance counters around a region of code, for benchmarks.
+// Uses perf_event_open() on Linux. On other platforms, or if the kernel
+// doesn't let us count (e.g. perf_event_paranoid or a VM without a PMU),
+// only wall time and number of calls are collected.
+//
+// Usage:
+//   PerfCounters c;
+//   for (...) { c.Start(); Work(); c.Stop(); }
+//   cerr << c.totals().IPC();
+class PerfCounters {
+ public:
+  enum Event {
+    CYCLES,
+    INSTRUCTIONS,
+    L1D_MISSES,
+    LLC_MISSES,
+    BRANCH_MISSES,
+
+    EVENT_COUNT,
+  };
+
+  struct Totals {
+    // Counts are scaled up if the kernel had to multiplex counters.
+    double events[EVENT_COUNT] = {};
+    double seconds = 0;
+    size_t calls = 0;
+
+    double IPC() const {
+      return events[INSTRUCTIONS] / events[CYCLES];
+    }
+  };
+
+  PerfCounters();
+  ~PerfCounters();
+
+  PerfCounters(const PerfCounters& rhs) = delete;
+  PerfCounters& operator=(const PerfCounters& rhs) = delete;
+
+  // False if the event couldn't be opened; its total stays zero.
+  bool Available(Event e) const {
+    return slot_[e] != -1;
+  }
+
+  // Regions may nest, but each PerfCounters must be started at most once at a time.
+  void Start();
+  void Stop();
+
+  const Totals& totals() const {
+    return totals_;
+  }
+  void Reset();
+
+  static const char* EventName(Event e);
+
+ private:
+  struct Reading {
+    uint64_t enabled = 0;
+    uint64_t running = 0;
+    uint64_t values[EVENT_COUNT] = {};
+  };
+
+  int leader_ = -1; // group leader fd
+  int fds_[EVENT_COUNT];
+  int slot_[EVENT_COUNT]; // position of the event in group reads, -1 if not available
+  int opened_ = 0;
+  Reading start_;
+  Stopwatch stopwatch_;
+  Totals totals_;
+
+  bool Read(Reading& r) const;
+};
+
+// Calls Start() in constructor and Stop() in destructor. Does nothing if `counters` is null.
+class PerfRegion {
+ public:
+  explicit PerfRegion(PerfCounters* counters): counters_(counters) {
+    if (counters_)
+      counters_->Start();
+  }
+  ~PerfRegion() {
+    if (counters_)
+      counters_->Stop();
+  }
+
+  PerfRegion(const PerfRegion& rhs) = delete;
+  PerfRegion& operator=(const PerfRegion& rhs) = delete;
+
+ private:
+  PerfCounters* counters_;
+};
@@ -0,0 +1,114 @@
+#include "util/quat-arrays.h"
+#include "util/simd.h"
+#include <cmath>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifdef CUBE_SIMD
+using simd::d4;
+
+// Lanes from member `f` of elements i..i+3, and back.
+#define LANES(s, i, f) simd::Set(s[i].f, s[i + 1].f, s[i + 2].f, s[i + 3].f)
+#define STORE_LANES(v, s, i, f) simd::Get(v, s[i].f, s[i + 1].f, s[i + 2].f, s[i + 3].f)
+#endif
+
+void NormalizeQuats(size_t n, Strided<dquat> q) {
+  size_t i = 0;
+#ifdef CUBE_SIMD
+  for (; i + 4 <= n; i += 4) {
+    d4 a = LANES(q, i, a), b = LANES(q, i, b), c = LANES(q, i, c), d = LANES(q, i, d);
+    d4 z = simd::Sqrt(a*a + b*b + c*c + d*d);
+    STORE_LANES(a / z, q, i, a);
+    STORE_LANES(b / z, q, i, b);
+    STORE_LANES(c / z, q, i, c);
+    STORE_LANES(d / z, q, i, d);
+  }
+#endif
+  for (; i < n; ++i)
+    q[i].NormalizeMe();
+}
+
+void QuatsToMatrices(size_t n, Strided<const dquat> q, Strided<dmat3> m) {
+  size_t i = 0;
+#ifdef CUBE_SIMD
+  // As tquat::ToMatrix() in util/quat.h.
+  const d4 one = simd::Splat(1), two = simd::Splat(2);
+  for (; i + 4 <= n; i += 4) {
+    d4 a = LANES(q, i, a), b = LANES(q, i, b), c = LANES(q, i, c), d = LANES(q, i, d);
+    d4 a2 = two * a;
+    STORE_LANES(one + two * (-c*c - d*d), m, i, m[0]);
+    STORE_LANES(two * (b*c) - d*a2, m, i, m[1]);
+    STORE_LANES(two * (b*d) + c*a2, m, i, m[2]);
+    STORE_LANES(two * (b*c) + d*a2, m, i, m[3]);
+    STORE_LANES(one + two * (-b*b - d*d), m, i, m[4]);
+    STORE_LANES(two * (c*d) - b*a2, m, i, m[5]);
+    STORE_LANES(two * (b*d) - c*a2, m, i, m[6]);
+    STORE_LANES(two * (c*d) + b*a2, m, i, m[7]);
+    STORE_LANES(one + two * (-b*b - c*c), m, i, m[8]);
+  }
+#endif
+  for (; i < n; ++i)
+    m[i] = q[i].ToMatrix();
+}
+
+void RotateVectors(size_t n, Strided<const dmat3> m, Strided<const dvec3> v, Strided<dvec3> out) {
+  for (size_t i = 0; i < n; ++i)
+    out[i] = m[i] * v[i];
+}
+
+void UnrotateVectors(size_t n, Strided<const dmat3> m, Strided<const dvec3> v, Strided<dvec3> out) {
+  for (size_t i = 0; i < n; ++i) {
+    const double* r = m[i].m;
+    dvec3 u = v[i];
+    out[i] = dvec3(u.x*r[0] + u.y*r[3] + u.z*r[6],
+                   u.x*r[1] + u.y*r[4] + u.z*r[7],
+                   u.x*r[2] + u.y*r[5] + u.z*r[8]);
+  }
+}
+
+void ModelMatrices(size_t n, const float* x, const float* y, const float* z, const fquat* q, fmat4* out) {
+  size_t i = 0;
+#ifdef __SSE2__
+  const __m128 one = _mm_set1_ps(1), two = _mm_set1_ps(2);
+  const __m128 last_row = _mm_setr_ps(0, 0, 0, 1);
+  for (; i + 4 <= n; i += 4) {
+    // Quaternions of four bodies to one component per register, one body per lane.
+    __m128 a = _mm_loadu_ps(&q[i].a), b = _mm_loadu_ps(&q[i + 1].a);
+    __m128 c = _mm_loadu_ps(&q[i + 2].a), d = _mm_loadu_ps(&q[i + 3].a);
+    _MM_TRANSPOSE4_PS(a, b, c, d);
+    __m128 bb = _mm_mul_ps(b, b), cc = _mm_mul_ps(c, c), dd = _mm_mul_ps(d, d);
+    __m128 ab = _mm_mul_ps(a, b), ac = _mm_mul_ps(a, c), ad = _mm_mul_ps(a, d);
+    __m128 bc = _mm_mul_ps(b, c), bd = _mm_mul_ps(b, d), cd = _mm_mul_ps(c, d);
+    __m128 r[3][4] = {
+      {_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(cc, dd))),
+       _mm_mul_ps(two, _mm_sub_ps(bc, ad)),
+       _mm_mul_ps(two, _mm_add_ps(bd, ac)),
+       _mm_loadu_ps(x + i)},
+      {_mm_mul_ps(two, _mm_add_ps(bc, ad)),
+       _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(bb, dd))),
+       _mm_mul_ps(two, _mm_sub_ps(cd, ab)),
+       _mm_loadu_ps(y + i)},
+      {_mm_mul_ps(two, _mm_sub_ps(bd, ac)),
+       _mm_mul_ps(two, _mm_add_ps(cd, ab)),
+       _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(bb, cc))),
+       _mm_loadu_ps(z + i)},
+    };
+    // Back to one body per register: row `row` of bodies i..i+3.
+    for (int row = 0; row < 3; ++row) {
+      _MM_TRANSPOSE4_PS(r[row][0], r[row][1], r[row][2], r[row][3]);
+      for (int j = 0; j < 4; ++j)
+        _mm_storeu_ps(out[i + j].m + row * 4, r[row][j]);
+    }
+    for (int j = 0; j < 4; ++j)
+      _mm_storeu_ps(out[i + j].m + 12, last_row);
+  }
+#endif
+  for (; i < n; ++i) {
+    float a = q[i].a, b = q[i].b, c = q[i].c, d = q[i].d;
+    out[i] = fmat4(1 - 2*(c*c + d*d), 2*(b*c - a*d), 2*(b*d + a*c), x[i],
+                   2*(b*c + a*d), 1 - 2*(b*b + d*d), 2*(c*d - a*b), y[i],
+                   2*(b*d - a*c), 2*(c*d + a*b), 1 - 2*(b*b + c*c), z[i],
+                   0, 0, 0, 1);
+  }
+}
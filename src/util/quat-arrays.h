@@ -0,0 +1,34 @@
+#pragma once
+#include "util/quat.h"
+#include <cstddef>
+#include <cstdint>
+
+// Rotation kernels over arrays of bodies: four bodies per iteration on SIMD lanes (util/simd.h for
+// doubles, SSE2 for floats) where available, one at a time otherwise. The double kernels give the
+// same results to the bit as the dquat, dmat3 and drot3 methods they batch.
+
+// Elements of type T `stride` bytes apart, e.g. one member of each struct in an array.
+template<typename T>
+struct Strided {
+  T* p;
+  size_t stride;
+
+  Strided(T* p, size_t stride = sizeof(T)) : p(p), stride(stride) {}
+  T& operator[](size_t i) const {
+    return *reinterpret_cast<T*>(reinterpret_cast<uintptr_t>(p) + i * stride);
+  }
+};
+
+// q[i].NormalizeMe().
+void NormalizeQuats(size_t n, Strided<dquat> q);
+
+// m[i] = q[i].ToMatrix().
+void QuatsToMatrices(size_t n, Strided<const dquat> q, Strided<dmat3> m);
+
+// out[i] = m[i] * v[i] (Rotate) or the transpose of m[i] times v[i] (Unrotate), as drot3 does.
+void RotateVectors(size_t n, Strided<const dmat3> m, Strided<const dvec3> v, Strided<dvec3> out);
+void UnrotateVectors(size_t n, Strided<const dmat3> m, Strided<const dvec3> v, Strided<dvec3> out);
+
+// out[i] = fmat4::Translation(fvec3(x[i], y[i], z[i])) * q[i].ToMatrix4() for unit q[i], computed
+// directly instead of as three 4x4 products.
+void ModelMatrices(size_t n, const float* x, const float* y, const float* z, const fquat* q, fmat4* out);
@@ -0,0 +1,136 @@
+#pragma once
+// Four lanes of doubles for the SIMD dquat product (end of util/quat.h), the array kernels of
+// util/quat-arrays.cpp and, with -DCUBE_SIMD_VEC3, dvec3 (util/vec-simd.h). Picked at compile
+// time: AVX2 if the compiler targets it (e.g. -march=native), SSE2 otherwise on x86-64, and the
+// plain scalar templates elsewhere, with -DCUBE_NO_SIMD, or without optimization (where the
+// wrappers below aren't inlined and cost three times what they save).
+//
+// Operations are done in the same order as in the scalar templates and never fused, so that results
+// are the same to the bit (unless the compiler contracts the scalar code into FMAs).
+// cube-vec-bench checks that and compares speed.
+
+#if !defined(CUBE_NO_SIMD) && defined(__OPTIMIZE__) && (defined(__AVX2__) || defined(__SSE2__))
+#define CUBE_SIMD 1
+#include <immintrin.h>
+
+namespace simd {
+
+#ifdef __AVX2__
+
+struct d4 {
+  __m256d v;
+};
+
+// Lanes from and to scalars, without going through memory.
+inline d4 Set(double a, double b, double c, double d) {
+  return d4{_mm256_setr_pd(a, b, c, d)};
+}
+inline void Get(d4 v, double& a, double& b, double& c, double& d) {
+  __m128d lo = _mm256_castpd256_pd128(v.v), hi = _mm256_extractf128_pd(v.v, 1);
+  a = _mm_cvtsd_f64(lo);
+  b = _mm_cvtsd_f64(_mm_unpackhi_pd(lo, lo));
+  c = _mm_cvtsd_f64(hi);
+  d = _mm_cvtsd_f64(_mm_unpackhi_pd(hi, hi));
+}
+// Stores lanes 0..3 or 0..2 at p.
+inline void Store(double* p, d4 a) {
+  _mm256_storeu_pd(p, a.v);
+}
+inline void Store3(double* p, d4 a) {
+  _mm256_maskstore_pd(p, _mm256_setr_epi64x(-1, -1, -1, 0), a.v);
+}
+inline d4 Splat(double s) {
+  return d4{_mm256_set1_pd(s)};
+}
+inline d4 operator+(d4 a, d4 b) { return d4{_mm256_add_pd(a.v, b.v)}; }
+inline d4 operator-(d4 a, d4 b) { return d4{_mm256_sub_pd(a.v, b.v)}; }
+inline d4 operator*(d4 a, d4 b) { return d4{_mm256_mul_pd(a.v, b.v)}; }
+inline d4 operator/(d4 a, d4 b) { return d4{_mm256_div_pd(a.v, b.v)}; }
+inline d4 operator-(d4 a) { return d4{_mm256_xor_pd(a.v, _mm256_set1_pd(-0.))}; }
+inline d4 Sqrt(d4 a) { return d4{_mm256_sqrt_pd(a.v)}; }
+inline d4 Min(d4 a, d4 b) { return d4{_mm256_min_pd(b.v, a.v)}; }
+inline d4 Max(d4 a, d4 b) { return d4{_mm256_max_pd(b.v, a.v)}; }
+// Flips the sign of lanes whose bit is set in `mask`.
+template<int mask>
+inline d4 Negate(d4 a) {
+  return d4{_mm256_xor_pd(a.v, _mm256_setr_pd(mask & 1 ? -0. : 0., mask & 2 ? -0. : 0.,
+                                              mask & 4 ? -0. : 0., mask & 8 ? -0. : 0.))};
+}
+// (a[i0], a[i1], a[i2], a[i3]).
+template<int i0, int i1, int i2, int i3>
+inline d4 Permute(d4 a) {
+  return d4{_mm256_permute4x64_pd(a.v, i0 | i1 << 2 | i2 << 4 | i3 << 6)};
+}
+// (x + y) + z, as in tvec3::Dot().
+inline double Sum3(d4 a) {
+  __m128d xy = _mm256_castpd256_pd128(a.v);
+  __m128d z = _mm256_extractf128_pd(a.v, 1);
+  return _mm_cvtsd_f64(_mm_add_sd(_mm_add_sd(xy, _mm_unpackhi_pd(xy, xy)), z));
+}
+
+#else // SSE2
+
+struct d4 {
+  __m128d lo, hi;
+};
+
+// Lanes from and to scalars, without going through memory.
+inline d4 Set(double a, double b, double c, double d) {
+  return d4{_mm_setr_pd(a, b), _mm_setr_pd(c, d)};
+}
+inline void Get(d4 v, double& a, double& b, double& c, double& d) {
+  a = _mm_cvtsd_f64(v.lo);
+  b = _mm_cvtsd_f64(_mm_unpackhi_pd(v.lo, v.lo));
+  c = _mm_cvtsd_f64(v.hi);
+  d = _mm_cvtsd_f64(_mm_unpackhi_pd(v.hi, v.hi));
+}
+inline void Store(double* p, d4 a) {
+  _mm_storeu_pd(p, a.lo);
+  _mm_storeu_pd(p + 2, a.hi);
+}
+inline void Store3(double* p, d4 a) {
+  _mm_storeu_pd(p, a.lo);
+  _mm_store_sd(p + 2, a.hi);
+}
+inline d4 Splat(double s) {
+  __m128d v = _mm_set1_pd(s);
+  return d4{v, v};
+}
+inline d4 operator+(d4 a, d4 b) { return d4{_mm_add_pd(a.lo, b.lo), _mm_add_pd(a.hi, b.hi)}; }
+inline d4 operator-(d4 a, d4 b) { return d4{_mm_sub_pd(a.lo, b.lo), _mm_sub_pd(a.hi, b.hi)}; }
+inline d4 operator*(d4 a, d4 b) { return d4{_mm_mul_pd(a.lo, b.lo), _mm_mul_pd(a.hi, b.hi)}; }
+inline d4 operator/(d4 a, d4 b) { return d4{_mm_div_pd(a.lo, b.lo), _mm_div_pd(a.hi, b.hi)}; }
+inline d4 operator-(d4 a) {
+  __m128d sign = _mm_set1_pd(-0.);
+  return d4{_mm_xor_pd(a.lo, sign), _mm_xor_pd(a.hi, sign)};
+}
+inline d4 Sqrt(d4 a) { return d4{_mm_sqrt_pd(a.lo), _mm_sqrt_pd(a.hi)}; }
+inline d4 Min(d4 a, d4 b) { return d4{_mm_min_pd(b.lo, a.lo), _mm_min_pd(b.hi, a.hi)}; }
+inline d4 Max(d4 a, d4 b) { return d4{_mm_max_pd(b.lo, a.lo), _mm_max_pd(b.hi, a.hi)}; }
+template<int mask>
+inline d4 Negate(d4 a) {
+  return d4{_mm_xor_pd(a.lo, _mm_setr_pd(mask & 1 ? -0. : 0., mask & 2 ? -0. : 0.)),
+            _mm_xor_pd(a.hi, _mm_setr_pd(mask & 4 ? -0. : 0., mask & 8 ? -0. : 0.))};
+}
+// (a[i], a[j]), one shufpd.
+template<int i, int j>
+inline __m128d Pick(d4 a) {
+  return _mm_shuffle_pd(i < 2 ? a.lo : a.hi, j < 2 ? a.lo : a.hi, (i & 1) | (j & 1) << 1);
+}
+template<int i0, int i1, int i2, int i3>
+inline d4 Permute(d4 a) {
+  return d4{Pick<i0, i1>(a), Pick<i2, i3>(a)};
+}
+inline double Sum3(d4 a) {
+  return _mm_cvtsd_f64(_mm_add_sd(_mm_add_sd(a.lo, _mm_unpackhi_pd(a.lo, a.lo)), a.hi));
+}
+
+#endif
+
+// (y, z, x, w) and (z, x, y, w), for cross products.
+inline d4 YZX(d4 a) { return Permute<1, 2, 0, 3>(a); }
+inline d4 ZXY(d4 a) { return Permute<2, 0, 1, 3>(a); }
+
+} // namespace simd
+
+#endif
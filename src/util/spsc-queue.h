@@ -0,0 +1,76 @@
+#pragma once
+#include <atomic>
+#include <vector>
+#include <cstddef>
+
+// Bounded lock-free queue for exactly one producer thread and one consumer thread.
+// Slots are allocated once and reused: the producer fills a slot in place, so e.g.
+// vectors inside elements keep their capacity and pushing doesn't allocate.
+//
+// Producer:                         Consumer:
+//   if (T* t = q.BeginPush()) {       if (T* t = q.Front()) {
+//     *t = ...;                         Use(*t);
+//     q.EndPush();                      q.Pop();
+//   }                                 }
+template<typename T>
+class SpscQueue {
+ public:
+  explicit SpscQueue(size_t capacity): slots_(capacity + 1) {}
+
+  SpscQueue(const SpscQueue& rhs) = delete;
+  SpscQueue& operator=(const SpscQueue& rhs) = delete;
+
+  // Producer side. Returns null if the queue is full.
+  T* BeginPush() {
+    size_t t = tail_.load(std::memory_order_relaxed);
+    if (Next(t) == head_.load(std::memory_order_acquire))
+      return nullptr;
+    return &slots_[t];
+  }
+  void EndPush() {
+    tail_.store(Next(tail_.load(std::memory_order_relaxed)), std::memory_order_release);
+  }
+  // Convenience for copyable elements. Returns false if the queue is full.
+  bool TryPush(const T& v) {
+    T* t = BeginPush();
+    if (!t)
+      return false;
+    *t = v;
+    EndPush();
+    return true;
+  }
+
+  // Consumer side. Returns null if the queue is empty.
+  T* Front() {
+    size_t h = head_.load(std::memory_order_relaxed);
+    if (h == tail_.load(std::memory_order_acquire))
+      return nullptr;
+    return &slots_[h];
+  }
+  void Pop() {
+    head_.store(Next(head_.load(std::memory_order_relaxed)), std::memory_order_release);
+  }
+
+  // Approximate if called concurrently with the other side.
+  bool Empty() const {
+    return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+  }
+  size_t capacity() const {
+    return slots_.size() - 1;
+  }
+
+ private:
+  // Keeps the two indices in different cache lines to avoid false sharing.
+  struct PaddedIndex: std::atomic<size_t> {
+    PaddedIndex(): std::atomic<size_t>(0) {}
+    char pad[64];
+  };
+
+  std::vector<T> slots_;
+  PaddedIndex head_; // next slot to pop; written by consumer
+  PaddedIndex tail_; // next slot to push; written by producer
+
+  size_t Next(size_t i) const {
+    return i + 1 == slots_.size() ? 0 : i + 1;
+  }
+};
@@ -8,6 +8,10 @@
 #include <mach/mach_time.h>
 #endif
 
+#ifdef __linux__
+#include <time.h>
+#endif
+
 #include <iostream>
 using namespace std;
 
@@ -21,6 +25,12 @@ static long long GetCurrentTime() {
 #ifdef __APPLE__
     return static_cast<long long>(mach_absolute_time());
 #endif
+
+#ifdef __linux__
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000LL + t.tv_nsec;
+#endif
 }
 
 static inline double GetClocksPerSecond() {
@@ -44,6 +54,10 @@ static inline double GetClocksPerSecond() {
         saved = 0;
 #endif
 
+#ifdef __linux__
+    saved = 1e9;
+#endif
+
 	return saved;
 }
     
@@ -0,0 +1,59 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+// Lock-free handoff of the latest value from one producer thread to one consumer thread.
+// Neither side ever waits: the producer always has a buffer to write to, and the consumer
+// always has the most recently published complete value to read. Intermediate values the
+// consumer didn't get to are dropped.
+//
+// Producer:                          Consumer:
+//   T& t = tb.back();                  tb.Update(); // true if there's a new value
+//   t = ...;                           Use(tb.front());
+//   tb.Publish();
+template<typename T>
+class TripleBuffer {
+ public:
+  TripleBuffer() = default;
+  TripleBuffer(const TripleBuffer& rhs) = delete;
+  TripleBuffer& operator=(const TripleBuffer& rhs) = delete;
+
+  // Producer side.
+  T& back() {
+    return buffers_[back_.value];
+  }
+  void Publish() {
+    // Swap back and middle buffers, marking middle as fresh.
+    back_.value = middle_.value.exchange(back_.value | kFresh, std::memory_order_acq_rel) & kIndex;
+  }
+
+  // Consumer side. Takes the latest published value, if there's one newer than front().
+  bool Update() {
+    if (!(middle_.value.load(std::memory_order_relaxed) & kFresh))
+      return false;
+    front_.value = middle_.value.exchange(front_.value, std::memory_order_acq_rel) & kIndex;
+    return true;
+  }
+  const T& front() const {
+    return buffers_[front_.value];
+  }
+  T& front() {
+    return buffers_[front_.value];
+  }
+
+ private:
+  static const uint8_t kIndex = 3;
+  static const uint8_t kFresh = 4;
+
+  // Keeps indices written by different threads in different cache lines.
+  template<typename U>
+  struct Padded {
+    U value;
+    char pad[64];
+  };
+
+  T buffers_[3];
+  Padded<std::atomic<uint8_t>> middle_{{1}};
+  Padded<uint8_t> back_{0};   // producer only
+  Padded<uint8_t> front_{2};  // consumer only
+};
@@ -0,0 +1,114 @@
+#pragma once
+// dvec3 on four SIMD lanes (see util/simd.h), with -DCUBE_SIMD_VEC3; included by util/vec.h.
+// Same interface as the tvec3 template, plus a fourth `pad` component that keeps vectors 32 bytes
+// apart in arrays. `pad` is not part of the value: it's 0 unless the vector was default-constructed,
+// and results carry whatever it computes to.
+//
+// Off by default: with three useful lanes out of four, moving components in and out of registers
+// costs about as much as the arithmetic saves (see cube-vec-bench), and arrays get a third larger.
+#include "simd.h"
+#if defined(CUBE_SIMD) && defined(CUBE_SIMD_VEC3)
+#include <cstdint>
+
+template<>
+struct alignas(16) tvec3<double> {
+  double x, y, z, pad;
+
+  tvec3() {}
+  tvec3(double x, double y, double z) : x(x), y(y), z(z), pad(0) {}
+
+  template<typename T>
+  tvec3(const tvec3<T> &v) : x((double)v.x), y((double)v.y), z((double)v.z), pad(0) {}
+
+  tvec3 operator - () const { return tvec3(-Lanes()); }
+
+  tvec3 operator + (const tvec3 &v) const { return tvec3(Lanes() + v.Lanes()); }
+  tvec3 operator - (const tvec3 &v) const { return tvec3(Lanes() - v.Lanes()); }
+  tvec3 operator * (double d) const { return tvec3(Lanes() * simd::Splat(d)); }
+  tvec3 operator * (const tvec3 &v) const { return tvec3(Lanes() * v.Lanes()); }
+  tvec3 operator / (double d) const { return *this * (1.0f / d); }
+
+  tvec3& operator += (const tvec3 &v) { return *this = *this + v; }
+  tvec3& operator -= (const tvec3 &v) { return *this = *this - v; }
+  tvec3& operator *= (double d) { return *this = *this * d; }
+  tvec3& operator *= (const tvec3 &v) { return *this = *this * v; }
+  tvec3& operator /= (double d) { return *this = *this / d; }
+
+  bool IsZero() const { return x == 0 && y == 0 && z == 0; }
+
+  double Dot(const tvec3 &v) const { return simd::Sum3(Lanes() * v.Lanes()); }
+  tvec3 Cross(const tvec3 &v) const {
+    simd::d4 a = Lanes(), b = v.Lanes();
+    return tvec3(simd::YZX(a) * simd::ZXY(b) - simd::ZXY(a) * simd::YZX(b));
+  }
+
+  // Defined in util/mat.h.
+  tmat3<double> Skew() const;
+
+  double LengthSquare() const { return Dot(*this); }
+  double Length() const { return sqrt(LengthSquare()); }
+
+  double DistanceSquare(const tvec3 &b) { return (b - *this).LengthSquare(); }
+  double Distance(const tvec3 &b) { return (b - *this).Length(); }
+
+  void NormalizeMe() { *this /= Length(); }
+  tvec3 Normalized() const { return *this / Length(); }
+
+  bool AllGreaterThan(const tvec3 &v) { return x > v.x && y > v.y && z > v.z; }
+  bool AllLessThan(const tvec3 &v) { return x < v.x && y < v.y && z < v.z; }
+  double MinComponent() const { return x < y ? x < z ? x : z : y < z ? y : z; }
+  double MaxComponent() const { return x > y ? x > z ? x : z : y > z ? y : z; }
+  tvec3 Min(const tvec3 &v) const { return tvec3(simd::Min(Lanes(), v.Lanes())); }
+  tvec3 Max(const tvec3 &v) const { return tvec3(simd::Max(Lanes(), v.Lanes())); }
+  tvec3 Abs() const { return tvec3(std::abs(x), std::abs(y), std::abs(z)); }
+  tvec3 Clamp(double a, double b) {
+    return tvec3(
+      x < a ? a : x > b ? b : x,
+      y < a ? a : y > b ? b : y,
+      z < a ? a : z > b ? b : z);
+  }
+
+  bool AllSameSign(const tvec3 &v) { return x * v.x > 0 && y * v.y > 0 && z * v.z > 0; }
+
+  void ToBarycentric(const tvec3 *triangle, double *out, bool clamp = false) {
+    tvec3 n = (triangle[1] - triangle[0]).Cross(triangle[2] - triangle[0]);
+
+    double sum = 0;
+
+    for (int i = 0; i < 3; ++i) {
+      out[i] = (triangle[(i + 2) % 3] - triangle[(i + 1) % 3]).Cross(*this - triangle[(i + 1) % 3]).Dot(n);
+      if (clamp && out[i] < 0)
+        out[i] = 0;
+      sum += out[i];
+    }
+
+    if (std::abs(sum) >= 1e-5) {
+      for(int i = 0; i < 3; ++i)
+        out[i] /= sum;
+    } else {
+      out[0] = out[1] = out[2] = 1./3;
+    }
+  }
+
+  void ToArray(double* p, size_t stride=1) const {
+    p[0] = x;
+    p[stride] = y;
+    p[stride + stride] = z;
+  }
+  void FromArray(const double* p, size_t stride=1) {
+    x = p[0];
+    y = p[stride];
+    z = p[stride + stride];
+  }
+  void AddToArrayMasked(double* p, uint8_t msk, size_t stride=1) {
+    if (msk & 1) { *p += x; p += stride; }
+    if (msk & 2) { *p += y; p += stride; }
+    if (msk & 4) *p += z;
+  }
+
+  // All four components as SIMD lanes.
+  simd::d4 Lanes() const { return simd::Set(x, y, z, pad); }
+  explicit tvec3(simd::d4 v) { simd::Get(v, x, y, z, pad); }
+};
+
+#endif
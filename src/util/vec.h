@@ -4,6 +4,7 @@
 #include <cmath>
 #include <algorithm>
 #include <ostream>
+#include <type_traits>
 
 template<typename T>
 struct tmat3;
@@ -142,11 +143,15 @@ struct tvec3 {
   }
 };
 
+// The scalar's type is not deduced, so that e.g. 2. * v works for tvec3s of any scalar.
 template<typename ftype>
-tvec3<ftype> operator*(ftype c, const tvec3<ftype>& v) {
+tvec3<ftype> operator*(typename std::common_type<ftype>::type c, const tvec3<ftype>& v) {
   return v*c;
 }
 
+// SIMD dvec3, if enabled.
+#include "vec-simd.h"
+
 template<typename ftype>
 struct tvec4 {
   ftype x, y, z, w;
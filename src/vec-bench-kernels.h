@@ -0,0 +1,82 @@
+// Kernels for cube-vec-bench, compiled twice: in vec-bench.cpp with the SIMD dvec3, dquat and
+// dmat3, and in vec-bench-scalar.cpp with the scalar templates. No include guard on purpose.
+//
+// Every kernel reads n records of kRecordSize doubles and writes n results of `outputs` doubles,
+// so that the two builds can be compared value by value.
+
+static const size_t kRecordSize = 24;
+
+// A record: two vectors, two unit quaternions, a matrix and a scalar.
+struct Record {
+  dvec3 v1, v2;
+  dquat q1, q2;
+  dmat3 m;
+  double s;
+
+  explicit Record(const double* p)
+    : v1(p[0], p[1], p[2]), v2(p[3], p[4], p[5]),
+      q1(p[6], p[7], p[8], p[9]), q2(p[10], p[11], p[12], p[13]),
+      m(p[14], p[15], p[16], p[17], p[18], p[19], p[20], p[21], p[22]),
+      s(p[23]) {}
+};
+
+static void Out(const dvec3& v, double* out) {
+  out[0] = v.x; out[1] = v.y; out[2] = v.z;
+}
+static void Out(const dquat& q, double* out) {
+  out[0] = q.a; out[1] = q.b; out[2] = q.c; out[3] = q.d;
+}
+static void Out(const dmat3& m, double* out) {
+  for (int i = 0; i < 9; ++i)
+    out[i] = m.m[i];
+}
+
+#define VEC_KERNEL(name, outputs, expr)                                   \
+  static void name(const double* in, double* out, size_t n) {             \
+    for (size_t i = 0; i < n; ++i, in += kRecordSize, out += outputs) {   \
+      Record r(in);                                                       \
+      expr;                                                               \
+    }                                                                     \
+  }
+
+VEC_KERNEL(AddScaled, 3, Out(r.v1 + r.v2 * r.s - r.v1 * r.v2, out))
+VEC_KERNEL(Dot, 1, *out = r.v1.Dot(r.v2))
+VEC_KERNEL(Cross, 3, Out(r.v1.Cross(r.v2), out))
+VEC_KERNEL(Normalize, 3, Out(r.v1.Normalized(), out))
+VEC_KERNEL(QuatProduct, 4, Out(r.q1 * r.q2, out))
+VEC_KERNEL(QuatTransform, 3, Out(r.q1.Transform(r.v1), out))
+VEC_KERNEL(QuatRotate, 3, Out(r.q1.Rotate(r.v1), out))
+// Two vectors per matrix, as in Scene::EnforceConstraints().
+VEC_KERNEL(Rot3Rotate, 6, drot3 m(r.q1); Out(m.Rotate(r.v1), out); Out(m.Unrotate(r.v2), out + 3))
+VEC_KERNEL(QuatToMatrix, 9, Out(r.q1.ToMatrix(), out))
+VEC_KERNEL(MatProduct, 9, Out(r.m * r.q1.ToMatrix(), out))
+VEC_KERNEL(MatVec, 3, Out(r.m * r.v1, out))
+VEC_KERNEL(Skew, 9, Out(r.v1.Skew() * r.m, out))
+// A constraint row as in ResolveForces().
+VEC_KERNEL(ConstraintRow, 9,
+  Out(-r.q1.ToMatrix() * r.v1.Skew() * r.m * r.q2.Conjugate().ToMatrix()
+      + (r.q1.Transform(r.v2) + r.v1).Skew() * (r.q1 * r.q2.Conjugate()).ToMatrix(), out))
+
+#undef VEC_KERNEL
+
+struct VecKernel {
+  const char* name;
+  size_t outputs;
+  void (*run)(const double* in, double* out, size_t n);
+};
+
+static const VecKernel kVecKernels[] = {
+  {"vec add/mul", 3, AddScaled},
+  {"vec dot", 1, Dot},
+  {"vec cross", 3, Cross},
+  {"vec normalize", 3, Normalize},
+  {"quat product", 4, QuatProduct},
+  {"quat transform", 3, QuatTransform},
+  {"quat rotate", 3, QuatRotate},
+  {"rot3 rotate x2", 6, Rot3Rotate},
+  {"quat to matrix", 9, QuatToMatrix},
+  {"mat product", 9, MatProduct},
+  {"mat * vec", 3, MatVec},
+  {"skew * mat", 9, Skew},
+  {"constraint row", 9, ConstraintRow},
+};
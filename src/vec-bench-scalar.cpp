@@ -0,0 +1,21 @@
+// The cube-vec-bench kernels on the scalar vector templates, as the reference for the SIMD ones.
+// The templates are wrapped in their own namespace, so that their tvec3<double> etc. don't clash with
+// the SIMD specializations in vec-bench.cpp.
+#ifndef CUBE_NO_SIMD
+#define CUBE_NO_SIMD
+#endif
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <type_traits>
+
+namespace scalar {
+#include "util/quat.h"
+#include "vec-bench-kernels.h"
+
+const VecKernel* kernels() {
+  return kVecKernels;
+}
+} // namespace scalar
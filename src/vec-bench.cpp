@@ -0,0 +1,123 @@
+// Micro-benchmark and accuracy check of the SIMD dvec3, dquat and dmat3 (util/simd.h) against the
+// scalar templates they replace.
+//
+// Usage: cube-vec-bench [--records N] [--reps N] [--max-ulp N]
+//
+// Runs every kernel of vec-bench-kernels.h on the same random inputs with both, reports time per
+// record and the largest difference of any output in units in the last place, and fails if that
+// exceeds --max-ulp (0 by default: the SIMD code is meant to round exactly as the scalar code).
+#include <chrono>
+#include <cinttypes>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "util/quat.h"
+#include "util/exceptions.h"
+using namespace std;
+
+namespace simd_kernels {
+#include "vec-bench-kernels.h"
+}
+
+namespace scalar {
+const simd_kernels::VecKernel* kernels();
+}
+
+// Distance between a and b in representable doubles; +0 and -0 are the same, and so are NaNs.
+static uint64_t UlpDistance(double a, double b) {
+  if (a == b || (std::isnan(a) && std::isnan(b)))
+    return 0;
+  if (std::isnan(a) || std::isnan(b))
+    return UINT64_MAX;
+  int64_t ia, ib;
+  memcpy(&ia, &a, sizeof(a));
+  memcpy(&ib, &b, sizeof(b));
+  if (ia < 0)
+    ia = INT64_MIN - ia;
+  if (ib < 0)
+    ib = INT64_MIN - ib;
+  return ia > ib ? (uint64_t)ia - (uint64_t)ib : (uint64_t)ib - (uint64_t)ia;
+}
+
+// Seconds per record of `reps` runs over all records.
+static double Time(const simd_kernels::VecKernel& k, const vector<double>& in, vector<double>& out,
+                   size_t records, int reps) {
+  auto start = chrono::steady_clock::now();
+  for (int i = 0; i < reps; ++i)
+    k.run(in.data(), out.data(), records);
+  return chrono::duration<double>(chrono::steady_clock::now() - start).count() / reps / records;
+}
+
+int main(int argc, char** argv) {
+  try {
+    size_t records = 1024;
+    int reps = 2000;
+    uint64_t max_ulp = 0;
+    for (int i = 1; i < argc; ++i) {
+      auto value = [&] {
+        if (i + 1 >= argc)
+          throw CommandLineArgumentsException(string("missing value for ") + argv[i]);
+        return argv[++i];
+      };
+      if (!strcmp(argv[i], "--records"))
+        records = atoi(value());
+      else if (!strcmp(argv[i], "--reps"))
+        reps = atoi(value());
+      else if (!strcmp(argv[i], "--max-ulp"))
+        max_ulp = atoi(value());
+      else
+        throw CommandLineArgumentsException(string("unknown argument ") + argv[i]);
+    }
+
+#if !defined(CUBE_SIMD)
+    cout << "SIMD: none (unoptimized or -DCUBE_NO_SIMD; both columns are the scalar templates)" << endl;
+#elif defined(__AVX2__)
+    cout << "SIMD: AVX2" << endl;
+#else
+    cout << "SIMD: SSE2" << endl;
+#endif
+
+    // Vectors and matrices in [-1, 1], unit quaternions, scalars in [-2, 2].
+    mt19937_64 rng(1);
+    uniform_real_distribution<double> uniform(-1, 1);
+    vector<double> in(records * simd_kernels::kRecordSize);
+    for (size_t i = 0; i < records; ++i) {
+      double* r = &in[i * simd_kernels::kRecordSize];
+      for (size_t j = 0; j < simd_kernels::kRecordSize; ++j)
+        r[j] = uniform(rng);
+      for (double* q : {r + 6, r + 10}) {
+        double l = sqrt(q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3]);
+        for (int j = 0; j < 4; ++j)
+          q[j] /= l;
+      }
+      r[23] *= 2;
+    }
+
+    bool ok = true;
+    printf("%-16s %12s %12s %8s %8s\n", "kernel", "scalar ns", "simd ns", "speedup", "max ulp");
+    const simd_kernels::VecKernel* scalar_kernels = scalar::kernels();
+    for (size_t i = 0; i < sizeof(simd_kernels::kVecKernels) / sizeof(simd_kernels::kVecKernels[0]); ++i) {
+      const simd_kernels::VecKernel& k = simd_kernels::kVecKernels[i];
+      vector<double> expected(records * k.outputs), actual(records * k.outputs);
+      double scalar_time = Time(scalar_kernels[i], in, expected, records, reps);
+      double simd_time = Time(k, in, actual, records, reps);
+      uint64_t ulp = 0;
+      for (size_t j = 0; j < expected.size(); ++j)
+        ulp = max(ulp, UlpDistance(expected[j], actual[j]));
+      printf("%-16s %12.2f %12.2f %8.2f %8" PRIu64 "\n", k.name, scalar_time * 1e9, simd_time * 1e9,
+             scalar_time / simd_time, ulp);
+      if (ulp > max_ulp)
+        ok = false;
+    }
+    if (!ok) {
+      cerr << "SIMD results differ from the scalar ones by more than " << max_ulp << " ulp" << endl;
+      return 1;
+    }
+  } catch (std::exception& e) {
+    std::cerr << "exception: " << e.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}